@@ -28,30 +28,262 @@ SOFTWARE.
 #include "Tools.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <list>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEKSTAUS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 #pragma intrinsic(memcmp, memcpy, memset, strcmp, strlen)
 
 //**********************************************************************************************************************
 
+namespace
+{
+    // A code point is counted at each byte that is not a continuation byte (10xxxxxx).  Read as signed, continuation
+    // bytes are exactly the values -128...-65, so the vector kernels only need one signed comparison per byte.
+
+    int UTF8_length_scalar(char const* p, size_t n) noexcept
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < n; ++i) result += (p[i] & 0xC0) != 0x80;
+        return int(result);
+    }
+
+#if defined(TEKSTAUS_X86)
+    int UTF8_length_sse2(char const* p, size_t n) noexcept
+    {
+        __m128i const limit = _mm_set1_epi8(-65);
+        __m128i const zero = _mm_setzero_si128();
+        size_t result = 0;
+        size_t i = 0;
+
+        while (n - i >= 16)
+        {
+            // The byte counters in 'sum' may wrap after 255 rounds, so they are folded into 'result' before that.
+            size_t const end = i + std::min<size_t>((n - i) / 16, 255) * 16;
+            __m128i sum = zero;
+
+            for (; i < end; i += 16)
+            {
+                sum = _mm_sub_epi8(sum, _mm_cmpgt_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i)), limit));
+            }
+
+            sum = _mm_sad_epu8(sum, zero);
+            result += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+        }
+
+        return int(result) + UTF8_length_scalar(p + i, n - i);
+    }
+
+    TARGET_AVX2 int UTF8_length_avx2(char const* p, size_t n) noexcept
+    {
+        __m256i const limit = _mm256_set1_epi8(-65);
+        __m256i const zero = _mm256_setzero_si256();
+        size_t result = 0;
+        size_t i = 0;
+
+        while (n - i >= 32)
+        {
+            size_t const end = i + std::min<size_t>((n - i) / 32, 255) * 32;
+            __m256i sum = zero;
+
+            for (; i < end; i += 32)
+            {
+                sum = _mm256_sub_epi8(sum, _mm256_cmpgt_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i)), limit));
+            }
+
+            sum = _mm256_sad_epu8(sum, zero);
+            __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            result += _mm_cvtsi128_si32(half) + _mm_extract_epi16(half, 4);
+        }
+
+        return int(result) + UTF8_length_sse2(p + i, n - i);
+    }
+
+    bool has_avx2() noexcept
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        if ((info[2] & 0x18000000) != 0x18000000) return false;  // OSXSAVE and AVX
+        if ((_xgetbv(0) & 6) != 6) return false;                  // XMM and YMM state enabled by the OS
+        __cpuidex(info, 7, 0);
+        return (info[1] & 0x20) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    int lowest_bit(unsigned n) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long k;
+        _BitScanForward(&k, n);
+        return int(k);
+#else
+        return __builtin_ctz(n);
+#endif
+    }
+
+    int highest_bit(unsigned n) noexcept
+    {
+#if defined(_MSC_VER)
+        unsigned long k;
+        _BitScanReverse(&k, n);
+        return int(k);
+#else
+        return 31 - __builtin_clz(n);
+#endif
+    }
+
+    int bit_count(unsigned n) noexcept
+    {
+        n -= (n >> 1) & 0x55555555;
+        n = (n & 0x33333333) + ((n >> 2) & 0x33333333);
+        return int((((n + (n >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+    }
+
+    // Bit i is set where byte i of the n <= 32 bytes at p starts a code point.
+
+    unsigned UTF8_starts(char const* p, size_t n) noexcept
+    {
+#if defined(TEKSTAUS_X86)
+        if (n == 32)
+        {
+            __m128i const limit = _mm_set1_epi8(-65);
+            auto a = _mm_cmpgt_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p)), limit);
+            auto b = _mm_cmpgt_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16)), limit);
+
+            return unsigned(_mm_movemask_epi8(a)) | unsigned(_mm_movemask_epi8(b)) << 16;
+        }
+#endif
+        unsigned result = 0;
+        for (size_t i = 0; i < n; ++i) result |= unsigned((p[i] & 0xC0) != 0x80) << i;
+        return result;
+    }
+
+    auto UTF8_length_kernel() noexcept -> int (*)(char const*, size_t)
+    {
+#if defined(TEKSTAUS_X86)
+        return has_avx2() ? UTF8_length_avx2 : UTF8_length_sse2;
+#else
+        return UTF8_length_scalar;
+#endif
+    }
+}
+
 int UTF8_length(char const* p, size_t n) noexcept
 {
+    static auto const kernel = UTF8_length_kernel();
+
     assert(p);
-    return int(n);
+    return n < 16 ? UTF8_length_scalar(p, n) : kernel(p, n);
 }
 
-size_t UTF8_size(char const* p, int n) noexcept
+// Bytes in the first n code points of the nSize bytes at p, which are never read past, as they need not be terminated.
+
+size_t UTF8_size(char const* p, size_t nSize, int n) noexcept
 {
     assert(p);
     if (n <= 0) { PROFILER; return 0; }
-    return size_t(n);
+
+    size_t i = 0;
+
+    do
+    {
+        while (++i < nSize && (p[i] & 0xC0) == 0x80);
+    } while (--n && i < nSize);
+
+    return i;
 }
 
 Char_t UTF8_char(char const* p) noexcept
 {
     assert(p);
-    PROFILER; return *p;
+
+    Char_t c = static_cast<unsigned char>(*p);
+    if (c < 0xC0) return c;  // ASCII, or a stray continuation byte
+
+    int n = c < 0xE0 ? 1 : c < 0xF0 ? 2 : c < 0xF8 ? 3 : c < 0xFC ? 4 : c < 0xFE ? 5 : 6;
+
+    for (c &= 0x3F >> n; n-- && (*++p & 0xC0) == 0x80; c = c << 6 | (*p & 0x3F));
+    return c;
+}
+
+// Sampled index of byte offsets: entry k is the offset of code point k * INDEX_STRIDE.  Locating any code point then
+// costs one lookup and a scan of fewer than INDEX_STRIDE code points.  The index is built lazily from noexcept lookups,
+// so when there is no memory for it the result is nullptr, and the caller scans from the start instead.
+
+int const INDEX_STRIDE = 128;
+
+size_t* UTF8_index(char const* p, size_t n, int length) noexcept
+{
+    assert(p && n && length > 0);
+
+    auto result = new(std::nothrow) size_t[length / INDEX_STRIDE + 1];
+    if (!result) { PROFILER; return nullptr; }
+
+    // The starts of code points are found 32 bytes at a time as a bit mask, and a sample that falls in a block is the
+    // position of its bit in the mask.  Only a length that is a multiple of INDEX_STRIDE has a sample at the very end.
+
+    int const last = length / INDEX_STRIDE;
+    int j = 0;
+    int k = 0;  // Code points that start before byte i
+
+    for (size_t i = 0; i < n && j <= last; i += 32)
+    {
+        auto const mask = UTF8_starts(p + i, std::min<size_t>(32, n - i));
+        auto const c = bit_count(mask);
+
+        for (; j <= last && j * INDEX_STRIDE < k + c; ++j)
+        {
+            auto r = mask;
+            for (auto t = j * INDEX_STRIDE - k; t; --t) r &= r - 1;
+            result[j] = i + lowest_bit(r);
+        }
+
+        k += c;
+    }
+
+    for (; j <= last; ++j) result[j] = n;
+
+    return result;
 }
 
 size_t char_size(Char_t c)
@@ -68,6 +300,358 @@ size_t char_size(Char_t c)
     return (c & 0xFFFFF800) ? (c & 0xFFFF0000) ? 4 : 3 : (c & 0xFFFFFF80) ? 2 : 1;
 }
 
+size_t UTF8_put(char* p, Char_t c) noexcept
+{
+    assert(p);
+
+    auto n = char_size(c);
+    if (n == 1) { *p = char(c); return 1; }
+
+    for (auto k = n; --k; c >>= 6) p[k] = char(0x80 | (c & 0x3F));
+    *p = char(0xFF00 >> n | c);
+
+    return n;
+}
+
+// Number of bytes at the end of p[0...n) that begin a UTF-8 sequence which continues past n.
+
+size_t UTF8_incomplete(char const* p, size_t n) noexcept
+{
+    assert(p);
+
+    for (size_t k = 1; k <= std::min<size_t>(n, 7); ++k)
+    {
+        auto c = static_cast<unsigned char>(p[n - k]);
+        if ((c & 0xC0) == 0x80) continue;
+        if (c < 0xC0) return 0;
+
+        size_t m = c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : c < 0xFC ? 5 : c < 0xFE ? 6 : 7;
+        return m > k ? k : 0;
+    }
+
+    return 0;
+}
+
+// Polynomial hash of a byte string modulo the Mersenne prime 2^61-1: H(b[0...n)) = sum of (b[i] + 1) * B^(n-1-i).  The
+// hash of a concatenation follows from the hashes of its halves as H(xy) = H(x) * B^|y| + H(y), so a node can combine
+// the cached hashes of its children in O(1).
+
+uint64_t const HASH_PRIME = (uint64_t(1) << 61) - 1;
+uint64_t const HASH_BASE = 0x0C5F3A1D94E27B69 % HASH_PRIME;
+
+uint64_t hash_add(uint64_t a, uint64_t b) noexcept
+{
+    auto r = a + b;
+    return r >= HASH_PRIME ? r - HASH_PRIME : r;
+}
+
+uint64_t hash_mul(uint64_t a, uint64_t b) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+    auto m = static_cast<unsigned __int128>(a) * b;
+    uint64_t lo = uint64_t(m), hi = uint64_t(m >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi, lo = _umul128(a, b, &hi);
+#else
+    uint64_t a0 = a & 0xFFFFFFFF, a1 = a >> 32, b0 = b & 0xFFFFFFFF, b1 = b >> 32;
+    uint64_t m = a0 * b1 + (a0 * b0 >> 32) + ((a1 * b0) & 0xFFFFFFFF);
+    uint64_t lo = a * b, hi = a1 * b1 + (m >> 32) + (a1 * b0 >> 32);
+#endif
+    auto r = (lo & HASH_PRIME) + (lo >> 61 | hi << 3);
+    r = (r & HASH_PRIME) + (r >> 61);
+    return r >= HASH_PRIME ? r - HASH_PRIME : r;
+}
+
+uint64_t hash_power(size_t n) noexcept
+{
+    uint64_t result = 1;
+
+    for (auto b = HASH_BASE; n; n >>= 1, b = hash_mul(b, b))
+    {
+        if (n & 1) result = hash_mul(result, b);
+    }
+
+    return result;
+}
+
+uint64_t hash_bytes(char const* p, size_t n) noexcept
+{
+    // Eight bytes are hashed by looking up (b + 1) * B^k for each position k from a table and adding the results, and
+    // eight values below 2^61 add up without overflow.  Four such groups make a round, and only the multiplication of
+    // the running result by B^32 is on the critical path.
+
+    struct Table
+    {
+        Table() noexcept
+        {
+            uint64_t b = 1;
+
+            for (int k = 0; k < 8; ++k, b = hash_mul(b, HASH_BASE))
+            {
+                for (int c = 0; c < 256; ++c) term[7 - k][c] = hash_mul(c + 1, b);
+            }
+
+            for (int k = 0; k < 4; ++k) power[k] = k ? hash_mul(power[k - 1], b) : b;
+        }
+
+        uint64_t group(unsigned char const* q) const noexcept
+        {
+            auto r = term[0][q[0]] + term[1][q[1]] + term[2][q[2]] + term[3][q[3]] + term[4][q[4]] + term[5][q[5]] + term[6][q[6]] + term[7][q[7]];
+            return hash_add(r & HASH_PRIME, r >> 61);
+        }
+
+        uint64_t term[8][256];
+        uint64_t power[4];  // B^8, B^16, B^24 and B^32
+    };
+
+    static Table const table;
+
+    assert(p || !n);
+
+    auto q = reinterpret_cast<unsigned char const*>(p);
+    uint64_t result = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        auto r = hash_add(hash_mul(table.group(q + i), table.power[2]), hash_mul(table.group(q + i + 8), table.power[1]));
+        r = hash_add(r, hash_add(hash_mul(table.group(q + i + 16), table.power[0]), table.group(q + i + 24)));
+        result = hash_add(hash_mul(result, table.power[3]), r);
+    }
+
+    for (; i + 8 <= n; i += 8) result = hash_add(hash_mul(result, table.power[0]), table.group(q + i));
+    for (; i < n; ++i) result = hash_add(hash_mul(result, HASH_BASE), table.term[7][q[i]]);
+
+    return result;
+}
+
+/***********************************************************************************************************************
+*** Pattern
+***********************************************************************************************************************/
+
+// A needle prepared for searching a haystack one piece at a time, left to right or right to left.  Needles of up to
+// FILTER_LIMIT bytes are located by comparing the first and the last byte at 16 candidate positions at once, and the
+// candidates that pass are checked with memcmp.  Longer needles use the Two-Way algorithm of Crochemore and Perrin,
+// which runs in linear time however repetitive the needle is.  Its critical factorization is computed once per search
+// rather than once per piece.
+//
+// Windows are numbered in the direction of the search, and the state between two windows is the next window j and
+// 'memory', the last position of its prefix that is already known to match, or -1.  A search stops at a window that
+// does not fit in the bytes at hand and can be resumed there with more of them.
+
+struct Pattern final
+{
+    Pattern(char const* p, size_t m, bool bReverse);
+
+    // The first matching window of a piece, or npos.  The piece is as stored, and read backwards when searching right
+    // to left.
+
+    size_t scan(char const* p, size_t n, ptrdiff_t& j, ptrdiff_t& memory) const noexcept;
+
+    // The first matching window before nLimit in bytes that are already in the order of the search, or npos, with the
+    // Two-Way algorithm whatever the length of the needle.
+
+    size_t resume(char const* p, size_t n, ptrdiff_t& j, ptrdiff_t& memory, ptrdiff_t nLimit) const noexcept { return two_way<false>(p, n, j, memory, nLimit); }
+
+    size_t size() const noexcept { return needle.size(); }
+
+    static size_t const npos = size_t(-1);
+    static size_t const FILTER_LIMIT = 64;
+
+private:
+    ptrdiff_t suffix(bool, ptrdiff_t&) const noexcept;
+    size_t filter(char const*, size_t) const noexcept;
+    template <bool bBackward> size_t two_way(char const*, size_t, ptrdiff_t&, ptrdiff_t&, ptrdiff_t) const noexcept;
+
+    std::string const needle;
+    std::string const key;     // The needle, reversed when searching right to left
+    bool const bReverse;
+    ptrdiff_t nCritical;        // Last position of the left half of the critical factorization of the key
+    ptrdiff_t nPeriod;          // Shift after a match
+    bool bPeriodic;             // The left half of the key occurs within the right half
+};
+
+Pattern::Pattern(char const* p, size_t m, bool bReverse) : needle(p, m), key(bReverse ? std::string(needle.rbegin(), needle.rend()) : needle),
+    bReverse(bReverse), nCritical(0), nPeriod(1), bPeriodic(false)
+{
+    assert(p && m);
+
+    ptrdiff_t p1, p2;
+    auto i = suffix(false, p1);
+    auto j = suffix(true, p2);
+
+    nCritical = std::max(i, j);
+    nPeriod = i > j ? p1 : p2;
+    bPeriodic = !memcmp(key.data(), key.data() + nPeriod, nCritical + 1);
+
+    if (!bPeriodic) nPeriod = std::max<ptrdiff_t>(nCritical + 1, ptrdiff_t(m) - nCritical - 1) + 1;
+}
+
+// Start of the maximal suffix of the key, one position early, and its period.  With 'bTilde' set the byte order is
+// reversed.  The critical factorization splits the key at the later of the two.
+
+ptrdiff_t Pattern::suffix(bool bTilde, ptrdiff_t& period) const noexcept
+{
+    auto x = reinterpret_cast<unsigned char const*>(key.data());
+    ptrdiff_t const m = key.size();
+    ptrdiff_t result = -1, j = 0, k = 1;
+
+    period = 1;
+
+    while (j + k < m)
+    {
+        auto a = x[j + k];
+        auto b = x[result + k];
+
+        if (bTilde ? a > b : a < b)
+        {
+            j += k;
+            k = 1;
+            period = j - result;
+        }
+        else if (a == b)
+        {
+            if (k != period) ++k; else { j += period; k = 1; }
+        }
+        else
+        {
+            result = j++;
+            k = period = 1;
+        }
+    }
+
+    return result;
+}
+
+// The filter has no state to carry, so it checks every window that fits, and the search goes on after them.
+
+size_t Pattern::scan(char const* p, size_t n, ptrdiff_t& j, ptrdiff_t& memory) const noexcept
+{
+    assert(p || !n);
+
+    ptrdiff_t const m = needle.size();
+    ptrdiff_t const end = ptrdiff_t(n) - m;
+
+    if (m > ptrdiff_t(FILTER_LIMIT)) return bReverse ? two_way<true>(p, n, j, memory, PTRDIFF_MAX) : two_way<false>(p, n, j, memory, PTRDIFF_MAX);
+    if (j > end) return npos;
+
+    auto i = bReverse ? filter(p, n - j) : filter(p + j, n - j);
+    if (i != npos) return bReverse ? n - i - m : j + i;
+
+    j = end + 1;
+    memory = -1;
+    return npos;
+}
+
+// The vector loops only look for blocks with candidates, so that the calls to memcmp do not force the comparison
+// vectors out of registers.
+
+size_t Pattern::filter(char const* p, size_t n) const noexcept
+{
+    auto const x = needle.data();
+    auto const m = needle.size();
+    auto const last = n - m;
+
+    if (!bReverse)
+    {
+        size_t i = 0;
+
+        if (m == 1)
+        {
+            auto q = static_cast<char const*>(memchr(p, x[0], n));
+            return q ? q - p : npos;
+        }
+#if defined(TEKSTAUS_X86)
+        while (i + 32 <= last + 1)
+        {
+            unsigned k = 0;
+
+            for (__m128i const head = _mm_set1_epi8(x[0]), tail = _mm_set1_epi8(x[m - 1]); i + 32 <= last + 1 && !k; i += 32)
+            {
+                auto a = _mm_and_si128(_mm_cmpeq_epi8(head, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i))),
+                    _mm_cmpeq_epi8(tail, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i + m - 1))));
+                auto b = _mm_and_si128(_mm_cmpeq_epi8(head, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i + 16))),
+                    _mm_cmpeq_epi8(tail, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i + 15 + m))));
+
+                k = unsigned(_mm_movemask_epi8(a)) | unsigned(_mm_movemask_epi8(b)) << 16;
+            }
+
+            for (; k; k &= k - 1)
+            {
+                auto r = i - 32 + lowest_bit(k);
+                if (!memcmp(p + r, x, m)) return r;
+            }
+        }
+#endif
+        for (; i <= last; ++i) if (p[i] == x[0] && !memcmp(p + i, x, m)) return i;
+        return npos;
+    }
+
+    // Right to left, the candidates below 'i' are yet to be checked.
+
+    auto i = last + 1;
+#if defined(TEKSTAUS_X86)
+    while (i >= 32)
+    {
+        unsigned k = 0;
+
+        for (__m128i const head = _mm_set1_epi8(x[0]), tail = _mm_set1_epi8(x[m - 1]); i >= 32 && !k; i -= 32)
+        {
+            auto a = _mm_and_si128(_mm_cmpeq_epi8(head, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i - 32))),
+                _mm_cmpeq_epi8(tail, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i - 33 + m))));
+            auto b = _mm_and_si128(_mm_cmpeq_epi8(head, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i - 16))),
+                _mm_cmpeq_epi8(tail, _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i - 17 + m))));
+
+            k = unsigned(_mm_movemask_epi8(a)) | unsigned(_mm_movemask_epi8(b)) << 16;
+        }
+
+        while (k)
+        {
+            auto bit = highest_bit(k);
+            auto r = i + bit;
+            if (!memcmp(p + r, x, m)) return r;
+            k &= ~(1u << bit);
+        }
+    }
+#endif
+    while (i--) if (p[i] == x[0] && !memcmp(p + i, x, m)) return i;
+    return npos;
+}
+
+// Backwards, the haystack is read from its end against the reversed needle.
+
+template <bool bBackward> size_t Pattern::two_way(char const* p, size_t n, ptrdiff_t& j, ptrdiff_t& memory, ptrdiff_t nLimit) const noexcept
+{
+    auto const x = reinterpret_cast<unsigned char const*>(key.data());
+    auto const y = reinterpret_cast<unsigned char const*>(p);
+    ptrdiff_t const m = key.size();
+    ptrdiff_t const end = ptrdiff_t(n) - m;
+
+    auto at = [y, n](ptrdiff_t k) noexcept { return bBackward ? y[ptrdiff_t(n) - 1 - k] : y[k]; };
+
+    while (j <= end && j < nLimit)
+    {
+        auto i = std::max(nCritical, memory) + 1;
+
+        while (i < m && x[i] == at(i + j)) ++i;
+
+        if (i < m)
+        {
+            j += i - nCritical;
+            memory = -1;
+            continue;
+        }
+
+        for (i = nCritical; i > memory && x[i] == at(i + j); --i);
+        if (i <= memory) return size_t(j);
+
+        j += nPeriod;
+        memory = bPeriodic ? m - nPeriod - 1 : -1;
+    }
+
+    return npos;
+}
+
 /***********************************************************************************************************************
 *** String::data
 ***********************************************************************************************************************/
@@ -75,7 +659,7 @@ size_t char_size(Char_t c)
 struct String::data : public Shared
 {
     static data const* create() noexcept;
-    static data const* create(char const*);
+    static data const* create(char const*, size_t);  // The bytes must be followed by a NUL
     static data const* create(Char_t, int);
 
     virtual data const* append(data const*) const = 0;
@@ -96,11 +680,152 @@ struct String::data : public Shared
     virtual char const* origin() const noexcept = 0;
     virtual int depth() const noexcept = 0;
 
+    virtual int count() const noexcept { return 0; }                   // Number of children of a concatenation node
+    virtual data const* child(int) const noexcept { return nullptr; }  // The children in order, none for leaves
+    virtual char const* span() const noexcept { return nullptr; }      // Start of the bytes of a leaf that has them
+
+    // Takes in a node after, or before, the contents in place, or returns false if it cannot.  Only called through
+    // grow(), for a node that nobody else holds.
+
+    virtual bool extend(data const*, bool) { return false; }
+
+    static data const* join(data const*, data const*);
+    static data const* concat(String const* const*, size_t);  // See String::Format
+    static data const* link(data const* const*, size_t);
+    static data const* grow(data const*, data const*, bool);
+    static bool growable(data const*) noexcept;
+    static bool enlarge(data const*, data const*, bool);
     static char const* evaluate(data const*&);
+    static void flatten(data const*, char*, size_t) noexcept;
+    static void limit(size_t, size_t) noexcept;
+    static void budget(size_t);
+
+    uint64_t hash() const noexcept;   // See hash_bytes(), kept by concatenations once known, computed by leaves each time
+    bool hashed(uint64_t&) const noexcept;  // The hash if it is known already
+    uint64_t power() const noexcept;  // HASH_BASE to the power of size(), kept like the hash
+
+    // What a concatenation keeps about its contents once it has folded it from its children.  Leaves have their bytes
+    // at hand and work the same out on demand, so they do not carry the space for it.
+
+    struct Folded
+    {
+        mutable std::atomic<uint64_t> nHash{ 0 };   // Hash with HASH_READY set, or zero until it is known
+        mutable std::atomic<uint64_t> nPower{ 0 };  // Never zero once it is known
+    };
+
+    virtual Folded const* folded() const noexcept { return nullptr; }
+
+    // The flat copy of a node that has no terminated buffer of its own, see 'Flat copies' below.  The copy is released
+    // along with the node, and leaves that do have a buffer never get one, so they do not carry the space for it.
+
+    struct Flattened
+    {
+        Flattened() = default;
+        Flattened(Flattened const&) = delete;
+        ~Flattened() { if (nFlat.load(std::memory_order_acquire) != FLAT_NONE) detach(this); }
+
+        mutable std::atomic<data const*> pFlat{ nullptr };
+        mutable std::atomic<unsigned char> nFlat{ FLAT_NONE };
+    };
+
+    virtual Flattened const* flattened() const noexcept { return nullptr; }
+
+    template <typename F> static data const* read_all(F&&);
+    static size_t const READ_CHUNK = 65536;
 
 protected:
-    size_t const BUFFER_LIMIT = 0;
-    size_t const STACK_LIMIT = 33554432;
+    data() = default;
+    explicit data(Immortal) noexcept : Shared(Immortal()) { }
+
+    static void* allocate(size_t, bool);  // Memory for a leaf of variable size, see 'Leaf memory' below
+    static void release(void*) noexcept;
+    static size_t capacity(void const*) noexcept;
+
+    virtual uint64_t digest() const noexcept;
+
+    static uint64_t const HASH_READY = uint64_t(1) << 63;
+
+    static bool coalesce(data const*, data const*) noexcept;
+
+    static std::atomic<size_t> nBufferLimit;  // See String::Coalesce()
+    static std::atomic<size_t> nSharedLimit;
+
+    enum : unsigned char { FLAT_NONE, FLAT_LISTED, FLAT_PINNED };
+
+    struct Memo;
+
+    static char const* pin(data const*, Flattened const*);
+    static data const* attached(data const*, Flattened const*);
+    static void detach(Flattened const*) noexcept;
+
+    static int const STACK_LIMIT = 33554432;
+    static int const FLATTEN_DEPTH = 128;  // Levels of the frame stack of flatten()
+};
+
+/***********************************************************************************************************************
+*** FlatIndex
+***********************************************************************************************************************/
+
+// Length and code point index of a contiguous run of bytes, both computed on first use.  Shared by the leaves that own
+// their bytes outright.
+
+struct FlatIndex final
+{
+    FlatIndex() = default;
+    explicit FlatIndex(int nLength) noexcept : nLength(nLength) { }  // When the length is known already
+    ~FlatIndex() { delete[] pIndex.load(std::memory_order_relaxed); }
+
+    void extend(int k) noexcept  // After k code points have been added to the bytes in place
+    {
+        if (auto n = nLength.load(std::memory_order_relaxed)) nLength.store(n + k, std::memory_order_relaxed);
+        delete[] pIndex.exchange(nullptr, std::memory_order_relaxed);
+    }
+
+    int length(char const* p, size_t n) const noexcept
+    {
+        auto k = nLength.load(std::memory_order_relaxed);
+        if (!k) nLength.store(k = UTF8_length(p, n), std::memory_order_relaxed);
+        return k;
+    }
+
+    size_t size(char const* p, size_t n, int k) const noexcept
+    {
+        auto length = this->length(p, n);
+
+        if (k <= 0) { PROFILER; return 0; }
+        if (k >= length) { PROFILER; return n; }
+        if (size_t(length) == n) { return size_t(k); }
+        if (length < INDEX_STRIDE) { return UTF8_size(p, n, k); }
+
+        auto q = index(p, n);
+        if (!q) { PROFILER; return UTF8_size(p, n, k); }
+
+        auto offset = q[k / INDEX_STRIDE];
+        return k % INDEX_STRIDE ? offset + UTF8_size(p + offset, n - offset, k % INDEX_STRIDE) : offset;
+    }
+
+    Char_t at(char const* p, size_t n, int k) const noexcept
+    {
+        if (k < 0) { PROFILER; return '\0'; }
+        if (k < length(p, n)) { return UTF8_char(p + size(p, n, k)); }
+        PROFILER; return '\0';
+    }
+
+private:
+    size_t const* index(char const* p, size_t n) const noexcept
+    {
+        auto q = pIndex.load(std::memory_order_acquire);
+        if (q) return q;
+
+        auto r = UTF8_index(p, n, length(p, n));
+        if (!r || pIndex.compare_exchange_strong(q, r, std::memory_order_acq_rel)) return r;
+
+        delete[] r;
+        return q;
+    }
+
+    mutable std::atomic<int> nLength{ 0 };
+    mutable std::atomic<size_t const*> pIndex{ nullptr };
 };
 
 /***********************************************************************************************************************
@@ -131,11 +856,32 @@ struct StrBuf final : public String::data, private ObjectGuard<StrBuf>
         cBuffer[nSize] = '\0';
     }
 
-    void* operator new(size_t n, size_t k, bool = false) { return ::operator new(n + k); }
-    void operator delete(void* p, size_t, bool) noexcept { ::operator delete(p); }
+    StrBuf(String const* const* p, size_t n, size_t nSize) : nSize(nSize), flat([p, n]() { int k = 0; for (size_t i = 0; i < n; ++i) k += p[i]->Length(); return k; }())
+    {
+        assert(p && n && nSize);
+
+        size_t k = 0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (auto m = p[i]->Size()) { p[i]->Get(cBuffer + k, m); k += m; }
+        }
+
+        assert(k == nSize);
+        cBuffer[nSize] = '\0';
+    }
+
+    // A buffer that may outlive the current String::Arena, such as the flat copy made for an existing string, is
+    // created with 'bShared' set.
+
+    void* operator new(size_t n, size_t k, bool bShared = false) { return allocate(n + k, bShared); }
+    void operator delete(void* p, size_t, bool) noexcept { release(p); }
+    void operator delete(void* p) noexcept { release(p); }
 
 private:
-    ~StrBuf() { }
+    friend struct Interned;
+
+    ~StrBuf();
 
     void* operator new(size_t) = delete;
 
@@ -146,37 +892,48 @@ private:
     String::data const* stretch(int n) const override final;
 
     void get(char*, size_t) const noexcept override final;
-    Char_t at(int n) const noexcept override final;
-    size_t size(int n) const noexcept override final;
+    Char_t at(int n) const noexcept override final { return flat.at(cBuffer, nSize, n); }
+    size_t size(int n) const noexcept override final { return flat.size(cBuffer, nSize, n); }
     size_t size() const noexcept override final { return nSize; }
-    int length() const noexcept override final { return nLength ? nLength : nLength = UTF8_length(cBuffer, nSize); }
+    int length() const noexcept override final { return flat.length(cBuffer, nSize); }
 
-    bool isASCII() const noexcept override final { PROFILER; return length() == nSize; }
+    bool isASCII() const noexcept override final { return length() == nSize; }
     char const* buffer() const noexcept override final { return cBuffer; }
     char const* extent() const noexcept override final { PROFILER; return cBuffer + nSize; }
     char const* origin() const noexcept override final { return cBuffer; }
     int depth() const noexcept override final { return 1; }
 
-    size_t const nSize;
-    mutable int nLength = 0;
-    mutable char const* pExtent = nullptr;
+    char const* span() const noexcept override final { return cBuffer; }
+
+    bool extend(String::data const* p, bool bFront) override final;
+
+    size_t nSize;
+    bool bInterned = false;
+    FlatIndex flat;
     char cBuffer[1];  // <---- This must be the last data item!
 };
 
 /***********************************************************************************************************************
-*** StrTail
+*** StrMap
 ***********************************************************************************************************************/
 
-struct StrTail final : public String::data, private ObjectGuard<StrTail>
+// Leaf over a read-only mapping of a file, which is unmapped when the last reference goes away.  The bytes after the
+// end of a file are zero up to the end of its last page, so the buffer is NUL terminated unless the file ends exactly
+// on a page boundary or the mapped window stops short of the end of the file.  An unterminated leaf never ends inside
+// a UTF-8 sequence, so that decoding its last code point does not read past the mapping.
+
+struct StrMap final : public String::data, public Pooled<StrMap>, private ObjectGuard<StrMap>
 {
-    StrTail(String::data const* p, int n) : pSource(p), nCursor(n)
+    using String::data::create;
+    static StrMap const* create(char const*, unsigned long long, size_t);
+
+private:
+    StrMap(void* pView, size_t nView, char const* p, size_t n, bool bTerminated) noexcept : pView(pView), nView(nView), pBytes(p), nSize(n), bTerminated(bTerminated)
     {
-        assert(p && n > 0 && n < p->length());
-        assert(dynamic_cast<StrBuf const*>(p));
+        assert(pView && p && n);
     }
 
-private:
-    ~StrTail() { Erase(pSource); }
+    ~StrMap();
 
     String::data const* append(String::data const* p) const override final;
     String::data const* head(int n) const override final;
@@ -185,39 +942,134 @@ private:
     String::data const* stretch(int n) const override final;
 
     void get(char*, size_t) const noexcept override final;
-    Char_t at(int n) const noexcept override final;
-    size_t size(int n) const noexcept override final;
-    size_t size() const noexcept override final { return nSize ? nSize : nSize = pSource->size() - skipsize(); }
-    int length() const noexcept override final { return nLength ? nLength : nLength = pSource->length() - nCursor; }
+    Char_t at(int n) const noexcept override final { return flat.at(pBytes, nSize, n); }
+    size_t size(int n) const noexcept override final { return flat.size(pBytes, nSize, n); }
+    size_t size() const noexcept override final { return nSize; }
+    int length() const noexcept override final { return flat.length(pBytes, nSize); }
 
-    bool isASCII() const noexcept override final { PROFILER; return length() == size(); }
-    char const* buffer() const noexcept override final { return pBuffer ? pBuffer : pBuffer = pSource->buffer() + skipsize(); }
-    char const* extent() const noexcept override final { PROFILER; return pExtent ? pExtent : pExtent = pSource->extent(); }
-    char const* origin() const noexcept override final { return pOrigin ? pOrigin : pOrigin = pSource->origin() + skipsize(); }
-    int depth() const noexcept override final { return 2; }
+    bool isASCII() const noexcept override final { return size_t(length()) == nSize; }
+    char const* buffer() const noexcept override final { return bTerminated ? pBytes : nullptr; }
+    char const* extent() const noexcept override final { return pBytes + nSize; }
+    char const* origin() const noexcept override final { return pBytes; }
+    int depth() const noexcept override final { return 1; }
 
-    size_t skipsize() const noexcept { return nSkip ? nSkip : nSkip = pSource->size(nCursor); }
+    char const* span() const noexcept override final { return pBytes; }
 
-    String::data const* const pSource;
-    int const nCursor;
-    mutable int nLength = 0;
-    mutable size_t nSize = 0;
-    mutable size_t nSkip = 0;
-    mutable char const* pBuffer = nullptr;
-    mutable char const* pExtent = nullptr;
-    mutable char const* pOrigin = nullptr;
+    Flattened const* flattened() const noexcept override final { return bTerminated ? nullptr : &copy; }
+
+    void* const pView;
+    size_t const nView;
+    char const* const pBytes;
+    size_t const nSize;
+    bool const bTerminated;
+    FlatIndex flat;
+    Flattened copy;
 };
 
 /***********************************************************************************************************************
-*** StrHead
+*** StrLit
 ***********************************************************************************************************************/
 
-struct StrHead final : public String::data, private ObjectGuard<StrHead>
+// Leaf over the storage of a string literal, see String::Literal.  The leaf is immortal, and the length that it starts
+// with comes from the compiler.
+
+struct StrLit final : public String::data
 {
-    StrHead(String::data const* p, int n) noexcept : pSource(p), nCursor(n)
-    {
+    using String::data::create;
+    static String::data const* create(String::Literal const&);
+
+private:
+    explicit StrLit(String::Literal const& r) noexcept : String::data(Immortal()), pBytes(r.pBytes), nSize(r.nSize), flat(r.nLength)
+    {
+        assert(pBytes && nSize && pBytes[nSize] == '\0');
+    }
+
+    String::data const* append(String::data const* p) const override final;
+    String::data const* head(int n) const override final;
+    String::data const* tail(int n) const override final;
+    String::data const* prepend(String::data const* p) const override final;
+    String::data const* stretch(int n) const override final;
+
+    void get(char*, size_t) const noexcept override final;
+    Char_t at(int n) const noexcept override final { return flat.at(pBytes, nSize, n); }
+    size_t size(int n) const noexcept override final { return flat.size(pBytes, nSize, n); }
+    size_t size() const noexcept override final { return nSize; }
+    int length() const noexcept override final { return flat.length(pBytes, nSize); }
+
+    bool isASCII() const noexcept override final { return size_t(length()) == nSize; }
+    char const* buffer() const noexcept override final { return pBytes; }
+    char const* extent() const noexcept override final { return pBytes + nSize; }
+    char const* origin() const noexcept override final { return pBytes; }
+    int depth() const noexcept override final { return 1; }
+
+    char const* span() const noexcept override final { return pBytes; }
+
+    char const* const pBytes;
+    size_t const nSize;
+    FlatIndex flat;
+};
+
+/***********************************************************************************************************************
+*** StrTail
+***********************************************************************************************************************/
+
+struct StrTail final : public String::data, public Pooled<StrTail>, private ObjectGuard<StrTail>
+{
+    StrTail(String::data const* p, int n) : pSource(p), nCursor(n), nLength(p->length() - n), nSkip(p->size(n)), nSize(p->size() - nSkip),
+        pBuffer(p->buffer() ? p->buffer() + nSkip : nullptr), pOrigin(p->origin() + nSkip), pExtent(p->extent())
+    {
+        assert(p && n > 0 && n < p->length());
+        assert(dynamic_cast<StrBuf const*>(p) || dynamic_cast<StrMap const*>(p) || dynamic_cast<StrLit const*>(p));
+    }
+
+private:
+    ~StrTail() { Erase(pSource); }
+
+    String::data const* append(String::data const* p) const override final;
+    String::data const* head(int n) const override final;
+    String::data const* tail(int n) const override final;
+    String::data const* prepend(String::data const* p) const override final;
+    String::data const* stretch(int n) const override final;
+
+    void get(char*, size_t) const noexcept override final;
+    Char_t at(int n) const noexcept override final;
+    size_t size(int n) const noexcept override final;
+    size_t size() const noexcept override final { return nSize; }
+    int length() const noexcept override final { return nLength; }
+
+    bool isASCII() const noexcept override final { PROFILER; return length() == size(); }
+    char const* buffer() const noexcept override final { return pBuffer; }
+    char const* extent() const noexcept override final { PROFILER; return pExtent; }
+    char const* origin() const noexcept override final { return pOrigin; }
+    int depth() const noexcept override final { return 2; }
+
+    char const* span() const noexcept override final { return pOrigin; }
+
+    void published() const noexcept override final { Publish(pSource); }
+
+    Flattened const* flattened() const noexcept override final { return pBuffer ? nullptr : &copy; }
+
+    String::data const* const pSource;
+    int const nCursor;
+    int const nLength;
+    size_t const nSkip;
+    size_t const nSize;
+    char const* const pBuffer;
+    char const* const pOrigin;
+    char const* const pExtent;
+    Flattened copy;
+};
+
+/***********************************************************************************************************************
+*** StrHead
+***********************************************************************************************************************/
+
+struct StrHead final : public String::data, public Pooled<StrHead>, private ObjectGuard<StrHead>
+{
+    StrHead(String::data const* p, int n) noexcept : pSource(p), nCursor(n), nSize(p->size(n)), pOrigin(p->origin()), pExtent(pOrigin + nSize), nDepth(p->depth() + 1)
+    {
         assert(p && n > 0 && n < p->length());
-        assert(dynamic_cast<StrBuf const*>(p) || dynamic_cast<StrTail const*>(p));
+        assert(dynamic_cast<StrBuf const*>(p) || dynamic_cast<StrMap const*>(p) || dynamic_cast<StrLit const*>(p) || dynamic_cast<StrTail const*>(p));
     }
 
 private:
@@ -232,36 +1084,46 @@ private:
     void get(char*, size_t) const noexcept override final;
     Char_t at(int n) const noexcept override final;
     size_t size(int n) const noexcept override final;
-    size_t size() const noexcept override final { return nSize ? nSize : nSize = pSource->size(nCursor); }
+    size_t size() const noexcept override final { return nSize; }
     int length() const noexcept override final { return nCursor; }
 
     bool isASCII() const noexcept override final { PROFILER; return length() == size(); }
     char const* buffer() const noexcept override final { return nullptr; }
-    char const* extent() const noexcept override final { return pExtent ? pExtent : pExtent = pSource->origin() + size(); }
-    char const* origin() const noexcept override final { return pOrigin ? pOrigin : pOrigin = pSource->origin(); }
-    int depth() const noexcept override final { return nDepth ? nDepth : nDepth = pSource->depth() + 1; }
+    char const* extent() const noexcept override final { return pExtent; }
+    char const* origin() const noexcept override final { return pOrigin; }
+    int depth() const noexcept override final { return nDepth; }
+
+    char const* span() const noexcept override final { return pOrigin; }
+
+    void published() const noexcept override final { Publish(pSource); }
+
+    Flattened const* flattened() const noexcept override final { return &copy; }
 
     String::data const* const pSource;
     int const nCursor;
-    mutable size_t nSize = 0;
-    mutable char const* pExtent = nullptr;
-    mutable char const* pOrigin = nullptr;
-    mutable int nDepth = 0;
+    size_t const nSize;
+    char const* const pOrigin;
+    char const* const pExtent;
+    int const nDepth;
+    Flattened copy;
 };
 
 /***********************************************************************************************************************
 *** StrCat
 ***********************************************************************************************************************/
 
-struct StrCat final : public String::data, private ObjectGuard<StrCat>
+struct StrCat final : public String::data, public Pooled<StrCat>, private ObjectGuard<StrCat>
 {
-    StrCat(String::data const* p, String::data const* q) noexcept : pHead(p), pTail(q)
+    StrCat(String::data const* p, String::data const* q) noexcept : pHead(p), pTail(q), nSize(p->size() + q->size()), nLength(p->length() + q->length()),
+        pOrigin(p->origin()), pExtent(q->extent()), nDepth(std::max(p->depth(), q->depth()) + 1)
     {
         assert(p && q);
         assert(pHead->length() > 0);
         assert(length() > pHead->length());
     }
 
+    static String::data const* balance(String::data const*, String::data const*);
+
 private:
     ~StrCat() { Erase(pHead); Erase(pTail); }
 
@@ -274,38 +1136,61 @@ private:
     void get(char*, size_t) const noexcept override final;
     Char_t at(int n) const noexcept override final;
     size_t size(int n) const noexcept override final;
-    size_t size() const noexcept override final { return nSize ? nSize : nSize = pHead->size() + pTail->size(); }
-    int length() const noexcept override final { return nLength ? nLength : nLength = pHead->length() + pTail->length(); }
+    size_t size() const noexcept override final { return nSize; }
+    int length() const noexcept override final { return nLength; }
 
     bool isASCII() const noexcept override final { PROFILER; return length() == size(); }
     char const* buffer() const noexcept override final { return nullptr; }
-    char const* extent() const noexcept override final { PROFILER; return pExtent ? pExtent : pExtent = pTail->extent(); }
-    char const* origin() const noexcept override final { return pOrigin ? pOrigin : pOrigin = pHead->origin(); }
-    int depth() const noexcept override final { return nDepth ? nDepth : nDepth = std::max(pHead->depth(), pTail->depth()) + 1; }
+    char const* extent() const noexcept override final { PROFILER; return pExtent; }
+    char const* origin() const noexcept override final { return pOrigin; }
+    int depth() const noexcept override final { return nDepth; }
+
+    int count() const noexcept override final { return 2; }
+    String::data const* child(int n) const noexcept override final { return n ? pTail : pHead; }
+
+    void published() const noexcept override final { Publish(pHead); Publish(pTail); }
+
+    bool extend(String::data const* p, bool bFront) override final;
+
+    Folded const* folded() const noexcept override final { return &cache; }
+    Flattened const* flattened() const noexcept override final { return &copy; }
 
     String::data const* const pHead;
     String::data const* const pTail;
-    mutable size_t nSize = 0;
-    mutable int nLength = 0;
-    mutable char const* pExtent = nullptr;
-    mutable char const* pOrigin = nullptr;
-    mutable int nDepth = 0;
+    size_t nSize;
+    int nLength;
+    char const* pOrigin;
+    char const* pExtent;
+    int nDepth;
+    Folded cache;
+    Flattened copy;
 };
 
 /***********************************************************************************************************************
 *** StrSum
 ***********************************************************************************************************************/
 
-struct StrSum final : public String::data, private ObjectGuard<StrSum>
+// References to nodes that are being put together as the children of a StrSum.  They are released if an exception
+// interrupts the building, and otherwise the new node takes them over.
+
+struct Refs final : public std::vector<String::data const*>
 {
-    StrSum(String::data const* p, String::data const* q) noexcept : source({ p, q })
-    {
-        // source.emplace_back(p);
-        // source.emplace_back(q);
-    }
+    Refs() = default;
+    Refs(Refs const&) = delete;
+    ~Refs() { for (auto p : *this) Shared::Erase(p); }
+};
+
+struct StrSum final : public String::data, public Pooled<StrSum>, private ObjectGuard<StrSum>
+{
+    StrSum(std::vector<String::data const*>&& v);  // Takes over the references in 'v', which is left empty
+    StrSum(String::data const* p, String::data const* q);  // The children of p and q, or p and q themselves
+
+    static size_t width(String::data const* p) noexcept;
+
+    static size_t const SUM_LIMIT = 32;
 
 private:
-    ~StrSum() { for (auto const& pSource : source) Erase(pSource); }
+    ~StrSum() { for (auto const& item : source) Erase(item.pSource); }
 
     String::data const* append(String::data const* p) const override final;
     String::data const* head(int n) const override final;
@@ -316,30 +1201,55 @@ private:
     void get(char*, size_t) const noexcept override final;
     Char_t at(int n) const noexcept override final;
     size_t size(int n) const noexcept override final;
-    size_t size() const noexcept override final;
-    int length() const noexcept override final;
+    size_t size() const noexcept override final { return source.back().nSize; }
+    int length() const noexcept override final { return source.back().nLength; }
 
     bool isASCII() const noexcept override final { PROFILER; return length() == size(); }
-    char const* buffer() const noexcept override final { PROFILER; return nullptr; }
-    char const* extent() const noexcept override final { PROFILER; return source.back()->extent(); }
-    char const* origin() const noexcept override final { PROFILER; return source.front()->origin(); }
-    int depth() const noexcept override final;
-
-    mutable std::vector<String::data const*> source;
-    mutable size_t nSize = 0;
-    mutable int nLength = 0;
-    mutable char const* pExtent = nullptr;
-    mutable char const* pOrigin = nullptr;
-    mutable int nDepth = 0;
+    char const* buffer() const noexcept override final { return nullptr; }
+    char const* extent() const noexcept override final { return source.back().pSource->extent(); }
+    char const* origin() const noexcept override final { return source.front().pSource->origin(); }
+    int depth() const noexcept override final { return nDepth; }
+
+    int count() const noexcept override final { return int(source.size()); }
+    String::data const* child(int n) const noexcept override final { return source[n].pSource; }
+
+    void published() const noexcept override final { for (auto const& item : source) Publish(item.pSource); }
+
+    bool extend(String::data const* p, bool bFront) override final;
+
+    Folded const* folded() const noexcept override final { return &cache; }
+    Flattened const* flattened() const noexcept override final { return &copy; }
+
+    size_t find(int n) const noexcept;
+    int start(size_t i) const noexcept { return i ? source[i - 1].nLength : 0; }
+    void add(String::data const* p) noexcept;
+
+    using String::data::create;
+    static String::data const* create(std::vector<String::data const*>&& v);
+
+    // Children in order, each with the length and size of the concatenation up to and including it, so that at(n)
+    // and size(n) can binary search for the child holding code point n.
+
+    struct Item
+    {
+        String::data const* pSource;
+        int nLength;
+        size_t nSize;
+    };
+
+    std::vector<Item> source;
+    int nDepth;
+    Folded cache;
+    Flattened copy;
 };
 
 /***********************************************************************************************************************
 *** StrRep
 ***********************************************************************************************************************/
 
-struct StrRep final : public String::data, private ObjectGuard<StrRep>
+struct StrRep final : public String::data, public Pooled<StrRep>, private ObjectGuard<StrRep>
 {
-    StrRep(Char_t c, int n) : cData(c), nLength(n)
+    StrRep(Char_t c, int n) : cData(c), nLength(n), nSize(char_size(c) * n)
     {
         assert(c && n);
     }
@@ -354,7 +1264,7 @@ private:
     void get(char*, size_t) const noexcept override final;
     Char_t at(int n) const noexcept override final;
     size_t size(int n) const noexcept override final;
-    size_t size() const noexcept override final { return nSize ? nSize : nSize = char_size(cData) * nLength; }
+    size_t size() const noexcept override final { return nSize; }
     int length() const noexcept override final { return nLength; }
 
     bool isASCII() const noexcept override final { PROFILER; return !(cData & 0xFFFFFF80); }
@@ -363,128 +1273,719 @@ private:
     char const* origin() const noexcept override final { return cookie - cData; }
     int depth() const noexcept override final { return 1; }
 
+    uint64_t digest() const noexcept override final;
+
+    Flattened const* flattened() const noexcept override final { return &copy; }
+
     char const* const cookie = nullptr;
 
     Char_t const cData;
     int const nLength;
-    mutable size_t nSize = 0;
+    size_t const nSize;
+    Flattened copy;
 };
 
 /***********************************************************************************************************************
-*** StrBuf
+*** Leaf memory
 ***********************************************************************************************************************/
 
-String::data const* StrBuf::append(String::data const* p) const
+// Every StrBuf is preceded by a header that tells where its memory came from: the innermost String::Arena of the
+// thread, a FixedPool of the smallest size class that fits, the heap, or for large buffers a mapping of its own.
+// The size classes step by a factor of 1.5 and 2 in turn: 64, 96, 128, 192, ... 32768.
+
+namespace
 {
-    assert(p);
-    return p->prepend(this);
+    struct Block
+    {
+        union
+        {
+            size_t nBytes;                  // MAPPED
+            String::Arena::Store* pStore;   // IN_ARENA
+        };
+
+        int nClass;                  // Size class, or one of the values below
+    };
+
+    int const IN_HEAP = -1;
+    int const MAPPED = -2;
+    int const IN_ARENA = -3;
+
+    size_t const HEADER = (sizeof(Block) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    size_t const ARENA_CHUNK = 65536;
+    size_t const MAPPED_LIMIT = 131072;
+
+    int const SIZE_CLASSES = 19;
+
+    constexpr size_t class_size(int i) noexcept
+    {
+        return i == 0 ? 64 : i % 2 ? size_t(3) << (5 + i / 2) : size_t(1) << (6 + i / 2);
+    }
+
+    int size_class(size_t n) noexcept
+    {
+        assert(n <= class_size(SIZE_CLASSES - 1));
+        if (n <= 64) return 0;
+
+        int b = 7;
+        while ((size_t(1) << b) < n) ++b;
+
+        return 2 * (b - 7) + 1 + (n - 1 >= size_t(3) << (b - 2));
+    }
+
+    struct SizeClass
+    {
+        void* (*allocate)();
+        void (*deallocate)(void*) noexcept;
+    };
+
+    template <size_t... I> SizeClass const* size_classes(std::index_sequence<I...>) noexcept
+    {
+        static SizeClass const table[] = { { &FixedPool<class_size(I)>::allocate, &FixedPool<class_size(I)>::deallocate }... };
+        return table;
+    }
+
+    // The table is reached through a function-local static, so that strings can be built during the static
+    // initialization of other translation units.
+
+    SizeClass const* pool() noexcept
+    {
+        return size_classes(std::make_index_sequence<SIZE_CLASSES>());
+    }
+
+    thread_local String::Arena* pCurrentArena = nullptr;
+
+    void* map(size_t n)
+    {
+#if defined(_WIN32)
+        auto p = VirtualAlloc(nullptr, n, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!p) throw std::bad_alloc();
+#else
+        auto p = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+#endif
+        return p;
+    }
+
+    void unmap(void* p, size_t n) noexcept
+    {
+#if defined(_WIN32)
+        (void)n;
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        munmap(p, n);
+#endif
+    }
 }
 
-String::data const* StrBuf::head(int n) const
+// Only the thread of an arena carves buffers from it, but they may be released on any thread, so only the count of live
+// buffers is atomic.  The arena holds one count of its own while it is in scope.  Chunks are kept in a FixedPool, as
+// the heap would hand them back to the system when an arena closes and fault them in again when the next one opens.
+
+struct String::Arena::Store final
 {
-    if (n <= 0) { PROFILER; return create(); }
-    if (n < length()) { return new StrHead(Clone(this), n); }
-    return Clone(this);
-}
+    std::atomic<size_t> nLive{ 1 };
+    char* pChunk = nullptr;  // Most recent chunk, which starts with a pointer to the previous one
+    char* pNext = nullptr;
+    char* pEnd = nullptr;
 
-String::data const* StrBuf::tail(int n) const
+    void release() noexcept
+    {
+        if (nLive.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        while (auto p = pChunk)
+        {
+            pChunk = *reinterpret_cast<char**>(p);
+            FixedPool<ARENA_CHUNK>::deallocate(p);
+        }
+
+        delete this;
+    }
+};
+
+void* String::data::allocate(size_t n, bool bShared)
 {
-    if (n <= 0) { PROFILER; return Clone(this); }
-    if (n < length()) { return new StrTail(Clone(this), n); }
-    return create();
+    n += HEADER;
+
+    Block* p;
+
+    if (auto pArena = bShared ? nullptr : pCurrentArena; pArena && n <= ARENA_CHUNK / 4)
+    {
+        n = (n + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+        if (!pArena->pStore) pArena->pStore = new Arena::Store;
+
+        auto pStore = pArena->pStore;
+
+        if (size_t(pStore->pEnd - pStore->pNext) < n)
+        {
+            PROFILER;
+            auto q = static_cast<char*>(FixedPool<ARENA_CHUNK>::allocate());
+
+            *reinterpret_cast<char**>(q) = pStore->pChunk;
+            pStore->pChunk = q;
+            pStore->pNext = q + HEADER;
+            pStore->pEnd = q + ARENA_CHUNK;
+        }
+
+        p = reinterpret_cast<Block*>(pStore->pNext);
+        pStore->pNext += n;
+        pStore->nLive.fetch_add(1, std::memory_order_relaxed);
+        p->pStore = pStore;
+        p->nClass = IN_ARENA;
+    }
+    else if (n <= class_size(SIZE_CLASSES - 1))
+    {
+        auto k = size_class(n);
+        p = static_cast<Block*>(pool()[k].allocate());
+        p->nClass = k;
+    }
+    else if (n < MAPPED_LIMIT)
+    {
+        p = static_cast<Block*>(::operator new(n));
+        p->nClass = IN_HEAP;
+    }
+    else
+    {
+        p = static_cast<Block*>(map(n));
+        p->nBytes = n;
+        p->nClass = MAPPED;
+    }
+
+    return reinterpret_cast<char*>(p) + HEADER;
 }
 
-String::data const* StrBuf::prepend(String::data const* p) const
+void String::data::release(void* q) noexcept
 {
-    assert(p);
-    if (p->size() + size() <= BUFFER_LIMIT || p->depth() >= STACK_LIMIT) { return new(p->size() + size()) StrBuf(p, this); }
-    return new StrCat(Clone(p), Clone(this));
+    if (!q) return;
+
+    auto p = reinterpret_cast<Block*>(static_cast<char*>(q) - HEADER);
+
+    switch (p->nClass)
+    {
+    case IN_ARENA:
+        p->pStore->release();
+        break;
+
+    case IN_HEAP:
+        ::operator delete(p);
+        break;
+
+    case MAPPED:
+        unmap(p, p->nBytes);
+        break;
+
+    default:
+        assert(p->nClass >= 0 && p->nClass < SIZE_CLASSES);
+        pool()[p->nClass].deallocate(p);
+        break;
+    }
 }
 
-String::data const* StrBuf::stretch(int n) const
+// Bytes that a block from allocate() can hold, which is at least what was asked for, or zero when it is not known.
+
+size_t String::data::capacity(void const* q) noexcept
 {
-    assert(n == 0);
-    PROFILER; return Clone(this);
+    assert(q);
+
+    auto p = reinterpret_cast<Block const*>(static_cast<char const*>(q) - HEADER);
+
+    switch (p->nClass)
+    {
+    case IN_ARENA:
+    case IN_HEAP:
+        return 0;
+
+    case MAPPED:
+        return p->nBytes - HEADER;
+
+    default:
+        assert(p->nClass >= 0 && p->nClass < SIZE_CLASSES);
+        return class_size(p->nClass) - HEADER;
+    }
 }
 
-void StrBuf::get(char* p, size_t n) const noexcept
+/***********************************************************************************************************************
+*** Interned
+***********************************************************************************************************************/
+
+// Weak table of the leaves created from char const* while interning is on, so that equal strings share one leaf.  A
+// leaf takes itself off the table when its last reference goes away.  A lookup that finds a leaf on its way out does
+// not revive it but puts a new leaf in its place, which the old one then leaves alone.  The table is split into shards
+// with a lock each, and like the pools it is never destroyed, since leaves may outlive static destruction.
+
+struct Interned final
 {
-    assert(p && n);
+    static StrBuf const* find(char const*, size_t);  // New reference to the shared leaf with these bytes
+    static void erase(StrBuf const*) noexcept;
 
-    if (n > nSize)
+    static size_t limit() noexcept { return nLimit.load(std::memory_order_relaxed); }
+    static void limit(size_t n) noexcept { nLimit.store(n, std::memory_order_relaxed); }
+
+private:
+    struct Key
     {
-        memcpy(p, cBuffer, nSize);
-        memset(p + nSize, '\0', n - nSize);
-    }
-    else
+        std::string_view view;
+        uint64_t nHash;
+
+        bool operator==(Key const& r) const noexcept { return view == r.view; }
+    };
+
+    struct Hash
     {
-        memcpy(p, cBuffer, n);
-    }
+        size_t operator()(Key const& r) const noexcept { return size_t(r.nHash); }
+    };
+
+    struct Shard
+    {
+        std::mutex lock;
+        std::unordered_map<Key, StrBuf const*, Hash> map;
+    };
+
+    static Shard& shard(uint64_t) noexcept;
+
+    static std::atomic<size_t> nLimit;  // See String::Intern()
+    static size_t const SHARDS = 64;
+};
+
+std::atomic<size_t> Interned::nLimit{ 0 };
+
+Interned::Shard& Interned::shard(uint64_t nHash) noexcept
+{
+    static auto const shards = new Shard[SHARDS];
+    return shards[(nHash >> 32) % SHARDS];
 }
 
-inline Char_t StrBuf::at(int n) const noexcept
+StrBuf const* Interned::find(char const* p, size_t n)
 {
-    if (n < 0) PROFILER; return '\0';
-    if (n < length()) { PROFILER; return UTF8_char(cBuffer + size(n)); }
-    PROFILER; return '\0';
+    auto nHash = hash_bytes(p, n);
+    auto& r = shard(nHash);
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    auto it = r.map.find(Key{ std::string_view(p, n), nHash });
+
+    if (it != r.map.end())
+    {
+        if (auto q = Shared::TryClone(it->second)) return q;
+
+        PROFILER;
+        r.map.erase(it);
+    }
+
+    auto q = new(n, true) StrBuf(p, n);
+
+    q->bInterned = true;
+    Shared::Publish(q);
+
+    r.map.emplace(Key{ std::string_view(q->cBuffer, n), nHash }, q);
+    return q;
 }
 
-size_t StrBuf::size(int n) const noexcept
+void Interned::erase(StrBuf const* p) noexcept
 {
-    if (n <= 0) { PROFILER; return 0; }
-    if (n < length()) { return UTF8_size(cBuffer, n); }
-    PROFILER; return nSize;
+    assert(p && p->bInterned);
+
+    auto nHash = hash_bytes(p->cBuffer, p->nSize);
+    auto& r = shard(nHash);
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    auto it = r.map.find(Key{ std::string_view(p->cBuffer, p->nSize), nHash });
+    if (it != r.map.end() && it->second == p) r.map.erase(it);
 }
 
 /***********************************************************************************************************************
-*** StrTail
+*** StrBuf
 ***********************************************************************************************************************/
 
-String::data const* StrTail::append(String::data const* p) const
+StrBuf::~StrBuf()
+{
+    if (bInterned) Interned::erase(this);
+}
+
+// The size class of a buffer usually leaves room after its end, and a piece that fits there is copied in, after the
+// bytes or, moving them out of the way, in front of them.
+
+bool StrBuf::extend(String::data const* p, bool bFront)
+{
+    assert(p && p->size() && !bInterned);
+
+    auto n = p->size();
+    auto nUsed = size_t(cBuffer - reinterpret_cast<char const*>(this)) + nSize + 1;
+
+    if (n > nBufferLimit.load(std::memory_order_relaxed) || nUsed + n > capacity(this)) return false;
+
+    if (bFront)
+    {
+        memmove(cBuffer + n, cBuffer, nSize + 1);
+        p->get(cBuffer, n);
+    }
+    else
+    {
+        p->get(cBuffer + nSize, n);
+        cBuffer[nSize + n] = '\0';
+    }
+
+    nSize += n;
+    flat.extend(p->length());
+    return true;
+}
+
+String::data const* StrBuf::append(String::data const* p) const
 {
     assert(p);
     return p->prepend(this);
 }
 
-String::data const* StrTail::head(int n) const
+String::data const* StrBuf::head(int n) const
 {
     if (n <= 0) { PROFILER; return create(); }
     if (n < length()) { return new StrHead(Clone(this), n); }
     return Clone(this);
 }
 
-String::data const* StrTail::tail(int n) const
+String::data const* StrBuf::tail(int n) const
 {
     if (n <= 0) { PROFILER; return Clone(this); }
-    if (n < length()) { return pSource->tail(nCursor + n); }
+    if (n < length()) { return new StrTail(Clone(this), n); }
     return create();
 }
 
-String::data const* StrTail::prepend(String::data const* p) const
+String::data const* StrBuf::prepend(String::data const* p) const
 {
     assert(p);
-    if (p->size() + size() <= BUFFER_LIMIT || p->depth() >= STACK_LIMIT) { return new(p->size() + size()) StrBuf(p, this); }
-    return new StrCat(Clone(p), Clone(this));
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
 }
 
-String::data const* StrTail::stretch(int n) const
+String::data const* StrBuf::stretch(int n) const
 {
-    assert(n >= 0 && n <= nCursor);
-    PROFILER; return pSource->tail(nCursor - n);
+    assert(n == 0);
+    PROFILER; return Clone(this);
 }
 
-void StrTail::get(char* p, size_t n) const noexcept
+void StrBuf::get(char* p, size_t n) const noexcept
 {
     assert(p && n);
 
-    if (n > size())
+    if (n > nSize)
     {
-        memcpy(p, buffer(), size());
+        memcpy(p, cBuffer, nSize);
+        memset(p + nSize, '\0', n - nSize);
+    }
+    else
+    {
+        memcpy(p, cBuffer, n);
+    }
+}
+
+/***********************************************************************************************************************
+*** StrMap
+***********************************************************************************************************************/
+
+StrMap const* StrMap::create(char const* szPath, unsigned long long nOffset, size_t nSize)
+{
+    assert(szPath);
+
+#if defined(_WIN32)
+    auto hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) throw "String::FromFile(): The file could not be opened.";
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size)) { CloseHandle(hFile); throw "String::FromFile(): The size of the file could not be read."; }
+
+    auto nFile = static_cast<unsigned long long>(size.QuadPart);
+#else
+    auto fd = open(szPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw "String::FromFile(): The file could not be opened.";
+
+    struct stat status;
+    if (fstat(fd, &status) < 0) { close(fd); throw "String::FromFile(): The size of the file could not be read."; }
+
+    auto nFile = static_cast<unsigned long long>(status.st_size);
+#endif
+
+    auto n = nOffset < nFile ? static_cast<size_t>(std::min<unsigned long long>(nSize, nFile - nOffset)) : 0;
+
+    // Positions within a string are ints, so a window larger than that is refused rather than silently truncated.
+
+    if (n > size_t(INT_MAX))
+    {
+#if defined(_WIN32)
+        CloseHandle(hFile);
+#else
+        close(fd);
+#endif
+        throw "String::FromFile(): The file is too large to be mapped as one string; map it in windows of at most 2 GB.";
+    }
+
+#if defined(_WIN32)
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+
+    auto nPage = size_t(system.dwPageSize);
+    auto nBase = nOffset / system.dwAllocationGranularity * system.dwAllocationGranularity;
+    auto nSkip = size_t(nOffset - nBase);
+    void* pView = nullptr;
+
+    if (n)
+    {
+        if (auto hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr))
+        {
+            pView = MapViewOfFile(hMapping, FILE_MAP_READ, DWORD(nBase >> 32), DWORD(nBase), nSkip + n);
+            CloseHandle(hMapping);
+        }
+    }
+
+    CloseHandle(hFile);
+    if (n && !pView) throw "String::FromFile(): The file could not be mapped.";
+#else
+    auto nPage = size_t(sysconf(_SC_PAGESIZE));
+    auto nBase = nOffset / nPage * nPage;
+    auto nSkip = size_t(nOffset - nBase);
+    void* pView = nullptr;
+
+    if (n)
+    {
+        pView = mmap(nullptr, nSkip + n, PROT_READ, MAP_PRIVATE, fd, off_t(nBase));
+        if (pView == MAP_FAILED) pView = nullptr;
+    }
+
+    close(fd);
+    if (n && !pView) throw "String::FromFile(): The file could not be mapped.";
+#endif
+
+    if (!n) { PROFILER; return nullptr; }
+
+    // A window that starts after the first byte of a UTF-8 sequence skips the rest of it, and one that is not NUL
+    // terminated leaves out a sequence that it cuts off at the end, so that the leaf holds whole code points only.
+
+    auto p = static_cast<char const*>(pView) + nSkip;
+    auto nView = nSkip + n;
+    auto bTerminated = nOffset + n == nFile && nView % nPage != 0;
+
+    for (int k = 0; nOffset && k < 6 && n && (*p & 0xC0) == 0x80; ++k) { ++p; --n; }
+    if (!bTerminated) n -= UTF8_incomplete(p, n);
+
+    if (!n)
+    {
+        PROFILER;
+#if defined(_WIN32)
+        UnmapViewOfFile(pView);
+#else
+        munmap(pView, nView);
+#endif
+        return nullptr;
+    }
+
+    return new StrMap(pView, nView, p, n, bTerminated);
+}
+
+StrMap::~StrMap()
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(pView);
+#else
+    munmap(pView, nView);
+#endif
+}
+
+String::data const* StrMap::append(String::data const* p) const
+{
+    assert(p);
+    return p->prepend(this);
+}
+
+String::data const* StrMap::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n < length()) { return new StrHead(Clone(this), n); }
+    return Clone(this);
+}
+
+String::data const* StrMap::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+    if (n < length()) { return new StrTail(Clone(this), n); }
+    return create();
+}
+
+String::data const* StrMap::prepend(String::data const* p) const
+{
+    assert(p);
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
+}
+
+String::data const* StrMap::stretch(int n) const
+{
+    assert(n == 0);
+    PROFILER; return Clone(this);
+}
+
+void StrMap::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+
+    if (n > nSize)
+    {
+        memcpy(p, pBytes, nSize);
+        memset(p + nSize, '\0', n - nSize);
+    }
+    else
+    {
+        memcpy(p, pBytes, n);
+    }
+}
+
+/***********************************************************************************************************************
+*** StrLit
+***********************************************************************************************************************/
+
+// The leaves are kept in a fixed table, keyed by the address and the size of the literal, that is searched and filled
+// without a lock.  A slot is claimed with a placeholder while its leaf is built, so that no two leaves are ever built
+// for the same literal.  A literal that finds no room within a few slots is copied like any other string instead.
+
+String::data const* StrLit::create(String::Literal const& r)
+{
+    assert(r.pBytes && r.nSize);
+
+    static size_t const SLOT_BITS = 12;
+    static size_t const PROBE_LIMIT = 16;
+    static auto const table = new std::atomic<StrLit const*>[size_t(1) << SLOT_BITS]();
+    static char const cBusy = '\0';
+
+    auto const pBusy = reinterpret_cast<StrLit const*>(&cBusy);
+    auto h = size_t((uint64_t(uintptr_t(r.pBytes)) ^ r.nSize) * 0x9E3779B97F4A7C15ull >> (64 - SLOT_BITS));
+
+    for (size_t i = 0; i < PROBE_LIMIT; ++i)
+    {
+        auto& slot = table[(h + i) & ((size_t(1) << SLOT_BITS) - 1)];
+        auto p = slot.load(std::memory_order_acquire);
+
+        if (!p && slot.compare_exchange_strong(p, pBusy, std::memory_order_acquire))
+        {
+            try
+            {
+                p = new StrLit(r);
+            }
+            catch (...)
+            {
+                slot.store(nullptr, std::memory_order_release);
+                throw;
+            }
+
+            slot.store(p, std::memory_order_release);
+            return p;
+        }
+
+        while (p == pBusy)
+        {
+            std::this_thread::yield();
+            p = slot.load(std::memory_order_acquire);
+        }
+
+        if (p->pBytes == r.pBytes && p->nSize == r.nSize) return p;
+    }
+
+    PROFILER; return String::data::create(r.pBytes, r.nSize);
+}
+
+String::data const* StrLit::append(String::data const* p) const
+{
+    assert(p);
+    return p->prepend(this);
+}
+
+String::data const* StrLit::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n < length()) { return new StrHead(Clone(this), n); }
+    return Clone(this);
+}
+
+String::data const* StrLit::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+    if (n < length()) { return new StrTail(Clone(this), n); }
+    return create();
+}
+
+String::data const* StrLit::prepend(String::data const* p) const
+{
+    assert(p);
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
+}
+
+String::data const* StrLit::stretch(int n) const
+{
+    assert(n == 0);
+    PROFILER; return Clone(this);
+}
+
+void StrLit::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+
+    if (n > nSize)
+    {
+        memcpy(p, pBytes, nSize);
+        memset(p + nSize, '\0', n - nSize);
+    }
+    else
+    {
+        memcpy(p, pBytes, n);
+    }
+}
+
+/***********************************************************************************************************************
+*** StrTail
+***********************************************************************************************************************/
+
+String::data const* StrTail::append(String::data const* p) const
+{
+    assert(p);
+    return p->prepend(this);
+}
+
+String::data const* StrTail::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n < length()) { return new StrHead(Clone(this), n); }
+    return Clone(this);
+}
+
+String::data const* StrTail::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+    if (n < length()) { return pSource->tail(nCursor + n); }
+    return create();
+}
+
+String::data const* StrTail::prepend(String::data const* p) const
+{
+    assert(p);
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
+}
+
+String::data const* StrTail::stretch(int n) const
+{
+    assert(n >= 0 && n <= nCursor);
+    PROFILER; return pSource->tail(nCursor - n);
+}
+
+void StrTail::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+
+    if (n > size())
+    {
+        memcpy(p, pOrigin, size());
         memset(p + size(), '\0', n - size());
     }
     else
     {
-        memcpy(p, buffer(), n);
+        memcpy(p, pOrigin, n);
     }
 }
 
@@ -498,7 +1999,7 @@ inline Char_t StrTail::at(int n) const noexcept
 inline size_t StrTail::size(int n) const noexcept
 {
     if (n <= 0) { PROFILER; return 0; }
-    if (n < length()) { return pSource->size(nCursor + n) - skipsize(); }
+    if (n < length()) { return pSource->size(nCursor + n) - nSkip; }
     PROFILER; return size();
 }
 
@@ -538,8 +2039,8 @@ String::data const* StrHead::tail(int n) const
 String::data const* StrHead::prepend(String::data const* p) const
 {
     assert(p);
-    if (p->size() + size() <= BUFFER_LIMIT || p->depth() >= STACK_LIMIT) { return new(p->size() + size()) StrBuf(p, this); }
-    return new StrCat(Clone(p), Clone(this));
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
 }
 
 String::data const* StrHead::stretch(int n) const
@@ -585,13 +2086,90 @@ inline size_t StrHead::size(int n) const noexcept
 *** StrCat
 ***********************************************************************************************************************/
 
+// Concatenation is a height balanced (AVL) join: the deeper operand is descended along its inner edge until the depths
+// are within one of each other, and on the way back up balance() rotates wherever a joined subtree grew too deep.  This
+// keeps the depth logarithmic in the number of leaves however the pieces are added, at O(depth) new nodes per join.
+
+String::data const* StrCat::balance(String::data const* p, String::data const* q)
+{
+    assert(p && q);
+
+    if (p->depth() > q->depth() + 1)
+    {
+        if (auto r = dynamic_cast<StrCat const*>(p))
+        {
+            auto s = dynamic_cast<StrCat const*>(r->pTail);
+
+            if (s && s->depth() > r->pHead->depth())
+            {
+                return new StrCat(new StrCat(Clone(r->pHead), Clone(s->pHead)), new StrCat(Clone(s->pTail), Clone(q)));
+            }
+
+            return new StrCat(Clone(r->pHead), new StrCat(Clone(r->pTail), Clone(q)));
+        }
+    }
+
+    if (q->depth() > p->depth() + 1)
+    {
+        if (auto r = dynamic_cast<StrCat const*>(q))
+        {
+            auto s = dynamic_cast<StrCat const*>(r->pHead);
+
+            if (s && s->depth() > r->pTail->depth())
+            {
+                return new StrCat(new StrCat(Clone(p), Clone(s->pHead)), new StrCat(Clone(s->pTail), Clone(r->pTail)));
+            }
+
+            return new StrCat(new StrCat(Clone(p), Clone(r->pHead)), Clone(r->pTail));
+        }
+    }
+
+    return new StrCat(Clone(p), Clone(q));
+}
+
 String::data const* StrCat::append(String::data const* p) const
 {
     assert(p);
 
-    if (pHead->depth() > std::max(p->depth(), pTail->depth()))
+    if (depth() > p->depth() + 1)
     {
         auto step0 = pTail->append(p);
+        auto step1 = balance(pHead, step0);
+
+        Erase(step0);
+
+        return step1;
+    }
+
+    return p->prepend(this);
+}
+
+// The last, or the first, child takes the piece in if nobody else holds it either, so appending to a string that owns
+// its rope only allocates when the leaf at the end is full.
+
+bool StrCat::extend(String::data const* p, bool bFront)
+{
+    assert(p);
+
+    if (!enlarge(bFront ? pHead : pTail, p, bFront)) return false;
+
+    nSize += p->size();
+    nLength += p->length();
+    pOrigin = pHead->origin();
+    pExtent = pTail->extent();
+    nDepth = std::max(pHead->depth(), pTail->depth()) + 1;
+    return true;
+}
+
+String::data const* StrCat::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n < pHead->length()) { return pHead->head(n); }
+    if (n == pHead->length()) { return Clone(pHead); }
+
+    if (n < length())
+    {
+        auto step0 = pTail->head(n - pHead->length());
         auto step1 = pHead->append(step0);
 
         Erase(step0);
@@ -599,345 +2177,2232 @@ String::data const* StrCat::append(String::data const* p) const
         return step1;
     }
 
-    return p->prepend(this);
+    return Clone(this);
+}
+
+String::data const* StrCat::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+
+    if (n < pHead->length())
+    {
+        auto step0 = pHead->tail(n);
+        auto step1 = step0->append(pTail);
+        Erase(step0);
+        return step1;
+    }
+
+    if (n == pHead->length()) { return Clone(pTail); }
+    if (n < length()) { return pTail->tail(n - pHead->length()); }
+    return create();
+}
+
+String::data const* StrCat::prepend(String::data const* p) const
+{
+    assert(p);
+
+    if (depth() > p->depth() + 1)
+    {
+        auto step0 = p->append(pHead);
+        auto step1 = balance(step0, pTail);
+
+        Erase(step0);
+
+        return step1;
+    }
+
+    if (coalesce(p, this)) { PROFILER; return new(p->size() + size()) StrBuf(p, this); }
+    return new StrCat(Clone(p), Clone(this));
+}
+
+String::data const* StrCat::stretch(int n) const
+{
+    auto step0 = pHead->stretch(n);
+    auto step1 = step0->append(pTail);
+
+    Erase(step0);
+
+    PROFILER; return step1;
+}
+
+void StrCat::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+    flatten(this, p, n);
+}
+
+Char_t StrCat::at(int n) const noexcept
+{
+    PROFILER; return n < pHead->length() ? pHead->at(n) : pTail->at(n - pHead->length());
+}
+
+size_t StrCat::size(int n) const noexcept
+{
+    if (n <= 0) { PROFILER; return 0; }
+    if (n < pHead->length()) { PROFILER; return pHead->size(n); }
+    if (n == pHead->length()) { PROFILER; return pHead->size(); }
+    if (n < length()) { PROFILER; return pHead->size() + pTail->size(n - pHead->length()); }
+    PROFILER; return size();
+}
+
+/***********************************************************************************************************************
+*** StrSum
+***********************************************************************************************************************/
+
+StrSum::StrSum(std::vector<String::data const*>&& v) : nDepth(0)
+{
+    assert(v.size() > 1);
+
+    source.reserve(v.size());
+    for (auto p : v) add(p);
+
+    v.clear();
+}
+
+// Clones the children straight into place, which spares join() a vector of its own for each pair that it puts together.
+
+StrSum::StrSum(String::data const* p, String::data const* q) : nDepth(0)
+{
+    assert(width(p) + width(q) <= SUM_LIMIT);
+
+    source.reserve(width(p) + width(q));
+
+    for (auto r : { p, q })
+    {
+        auto s = dynamic_cast<StrSum const*>(r);
+
+        if (!s) { add(Clone(r)); continue; }
+        for (auto const& item : s->source) add(Clone(item.pSource));
+    }
+}
+
+// Takes over the reference to p as the last child.  There is room reserved for it.
+
+void StrSum::add(String::data const* p) noexcept
+{
+    assert(p && p->length() > 0 && source.size() < source.capacity());
+
+    source.push_back({ p, start(source.size()) + p->length(), (source.empty() ? 0 : source.back().nSize) + p->size() });
+    nDepth = std::max(nDepth, p->depth() + 1);
+}
+
+size_t StrSum::width(String::data const* p) noexcept
+{
+    auto q = dynamic_cast<StrSum const*>(p);
+    return q ? q->source.size() : dynamic_cast<StrCat const*>(p) ? SUM_LIMIT + 1 : 1;
+}
+
+String::data const* StrSum::create(std::vector<String::data const*>&& v)
+{
+    assert(!v.empty());
+    if (v.size() > 1) { return new StrSum(std::move(v)); }
+
+    auto p = v.front();
+    v.clear();
+    return p;
+}
+
+size_t StrSum::find(int n) const noexcept
+{
+    return std::upper_bound(source.begin(), source.end(), n, [](int n, Item const& r) { return n < r.nLength; }) - source.begin();
+}
+
+String::data const* StrSum::append(String::data const* p) const
+{
+    assert(p);
+
+    if (width(p) != 1) return p->prepend(this);
+
+    auto bStretch = p->origin() == extent();
+
+    if (bStretch || coalesce(source.back().pSource, p))
+    {
+        Refs v;
+
+        v.reserve(source.size());
+        for (auto const& item : source) v.push_back(Clone(item.pSource));
+
+        auto q = v.back();
+        v.back() = bStretch ? q->append(p) : new(q->size() + p->size()) StrBuf(q, p);
+        Erase(q);
+
+        return create(std::move(v));
+    }
+
+    return join(this, p);
+}
+
+// A piece that is small enough is merged into the first or the last child, as by append() and prepend(), and otherwise
+// it becomes a child of its own while there is room.
+
+bool StrSum::extend(String::data const* p, bool bFront)
+{
+    assert(p && p->size());
+
+    if (p->count()) return false;  // Concatenations are not children of a StrSum, see join()
+
+    auto i = bFront ? size_t(0) : source.size() - 1;
+    auto q = source[i].pSource;
+
+    if (bFront ? coalesce(p, q) : coalesce(q, p))
+    {
+        if (!enlarge(q, p, bFront))
+        {
+            source[i].pSource = bFront ? new(p->size() + q->size()) StrBuf(p, q) : new(q->size() + p->size()) StrBuf(q, p);
+            Erase(q);
+        }
+    }
+    else if (source.size() < SUM_LIMIT)
+    {
+        source.reserve(source.size() + 1);
+        source.insert(bFront ? source.begin() : source.end(), { Clone(p), 0, 0 });
+        nDepth = std::max(nDepth, p->depth() + 1);
+    }
+    else
+    {
+        return false;
+    }
+
+    for (auto k = i; k < source.size(); ++k)
+    {
+        source[k].nLength = start(k) + source[k].pSource->length();
+        source[k].nSize = (k ? source[k - 1].nSize : 0) + source[k].pSource->size();
+    }
+
+    return true;
+}
+
+String::data const* StrSum::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n >= length()) { return Clone(this); }
+
+    auto i = find(n);
+    Refs v;
+
+    v.reserve(i + 1);
+    for (size_t k = 0; k < i; ++k) v.push_back(Clone(source[k].pSource));
+    if (n > start(i)) v.push_back(source[i].pSource->head(n - start(i)));
+
+    return create(std::move(v));
+}
+
+String::data const* StrSum::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+    if (n >= length()) { return create(); }
+
+    auto i = find(n);
+    Refs v;
+
+    v.reserve(source.size() - i);
+    v.push_back(source[i].pSource->tail(n - start(i)));
+    for (auto k = i + 1; k < source.size(); ++k) v.push_back(Clone(source[k].pSource));
+
+    return create(std::move(v));
+}
+
+String::data const* StrSum::prepend(String::data const* p) const
+{
+    assert(p);
+
+    if (coalesce(p, this)) { PROFILER; return new(p->size() + size()) StrBuf(p, this); }
+
+    if (width(p) == 1 && coalesce(p, source.front().pSource))
+    {
+        Refs v;
+
+        v.reserve(source.size());
+        for (auto const& item : source) v.push_back(Clone(item.pSource));
+
+        auto q = v.front();
+        v.front() = new(p->size() + q->size()) StrBuf(p, q);
+        Erase(q);
+
+        return create(std::move(v));
+    }
+
+    return join(p, this);
+}
+
+String::data const* StrSum::stretch(int n) const
+{
+    Refs v;
+
+    v.reserve(source.size());
+    for (auto const& item : source) v.push_back(Clone(item.pSource));
+
+    auto q = v.front();
+    v.front() = q->stretch(n);
+    Erase(q);
+
+    PROFILER; return create(std::move(v));
+}
+
+void StrSum::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+    flatten(this, p, n);
+}
+
+Char_t StrSum::at(int n) const noexcept
+{
+    if (n < 0 || n >= length()) { PROFILER; return '\0'; }
+
+    auto i = find(n);
+    return source[i].pSource->at(n - start(i));
+}
+
+size_t StrSum::size(int n) const noexcept
+{
+    if (n <= 0) { PROFILER; return 0; }
+    if (n >= length()) { PROFILER; return size(); }
+
+    auto i = find(n);
+    return (i ? source[i - 1].nSize : 0) + source[i].pSource->size(n - start(i));
+}
+
+/***********************************************************************************************************************
+*** StrRep
+***********************************************************************************************************************/
+
+String::data const* StrRep::append(String::data const* p) const
+{
+    assert(p);
+    if (p->origin() == extent()) { return p->stretch(length()); }
+    return p->prepend(this);
+}
+
+String::data const* StrRep::head(int n) const
+{
+    if (n <= 0) { PROFILER; return create(); }
+    if (n < length()) { return create(cData, n); }
+    return Clone(this);
+}
+
+String::data const* StrRep::tail(int n) const
+{
+    if (n <= 0) { PROFILER; return Clone(this); }
+    if (n < length()) { return create(cData, nLength - n); }
+    return create();
+}
+
+String::data const* StrRep::prepend(String::data const* p) const
+{
+    assert(p);
+    if (coalesce(p, this)) { return new(p->size() + size()) StrBuf(p, this); }
+    return join(p, this);
+}
+
+String::data const* StrRep::stretch(int n) const
+{
+    assert(n > 0);
+    return create(cData, nLength + n);
+}
+
+void StrRep::get(char* p, size_t n) const noexcept
+{
+    assert(p && n);
+
+    char c[8];
+    auto k = UTF8_put(c, cData);
+    auto m = std::min(n, nSize);
+
+    if (k == 1)
+    {
+        memset(p, c[0], m);
+    }
+    else
+    {
+        auto i = std::min(m, k);
+
+        memcpy(p, c, i);
+        for (; 2 * i <= m; i *= 2) memcpy(p + i, p, i);  // Whole characters, since i stays a multiple of k
+        memcpy(p + i, p, m - i);                         // The rest, which may cut a character off at n
+    }
+
+    if (n > nSize) memset(p + nSize, '\0', n - nSize);
+}
+
+Char_t StrRep::at(int n) const noexcept
+{
+    if (n < 0)
+    {
+        PROFILER; return 0;
+    }
+
+    if (n < nLength)
+    {
+        PROFILER; return cData;
+    }
+
+    PROFILER; return 0;
+}
+
+size_t StrRep::size(int n) const noexcept
+{
+    if (n <= 0) { PROFILER; return 0; }
+    if (n < length()) { PROFILER; return char_size(cData) * n; }
+    PROFILER; return size();
+}
+
+// Doubles the hash of one character as many times as there are bits in the count, like hash_power() does.
+
+uint64_t StrRep::digest() const noexcept
+{
+    char c[8];
+    auto k = UTF8_put(c, cData);
+    auto h = hash_bytes(c, k);
+    auto b = hash_power(k);
+    uint64_t result = 0;
+
+    for (auto n = nLength; n; n >>= 1)
+    {
+        if (n & 1) result = hash_add(hash_mul(result, b), h);
+        h = hash_add(hash_mul(h, b), h);
+        b = hash_mul(b, b);
+    }
+
+    return result;
+}
+
+/***********************************************************************************************************************
+*** String::data
+***********************************************************************************************************************/
+
+String::data const* String::data::create() noexcept
+{
+    struct Empty final : public String::data
+    {
+        Empty() noexcept : data(Immortal()) { }
+
+    private:
+        data const* append(data const* p) const override final { assert(p); return Clone(p); }
+        data const* head(int) const override final { return Clone(this); }
+        data const* tail(int) const override final { return Clone(this); }
+        data const* prepend(data const* p) const override final { assert(p); return Clone(p); }
+        data const* stretch(int n) const override final { if (n) FAIL("An attempt was made to stretch an unstretchable string data object."); PROFILER; return Clone(this); }
+
+        void get(char* p, size_t n) const noexcept override final { assert(p && n); memset(p, '\0', n); }
+        Char_t at(int) const noexcept override final { PROFILER; return 0; }
+        size_t size(int) const noexcept override final { PROFILER; return 0; }
+        size_t size() const noexcept override final { PROFILER; return 0; }
+        int length() const noexcept override final { PROFILER; return 0; }
+
+        bool isASCII() const noexcept override final { PROFILER; return true; }
+        char const* buffer() const noexcept override final { return &cData; }
+        char const* extent() const noexcept override final { PROFILER; return &cData; }
+        char const* origin() const noexcept override final { return &cData; }
+        int depth() const noexcept override final { return 0; }
+
+        char const cData = '\0';
+    };
+
+    // Never destroyed, like the other immortal nodes, since strings may still be released during static destruction.
+
+    alignas(Empty) static char storage[sizeof(Empty)];
+    static auto const p = new(storage) Empty;
+
+    return Clone(p);
+}
+
+String::data const* String::data::create(char const* p, size_t n)
+{
+    assert(p && p[n] == '\0');
+
+    if (n > 0)
+    {
+        if (n <= Interned::limit()) return Interned::find(p, n);
+        return new(n) StrBuf(p, n);
+    }
+
+    PROFILER; return create();
+}
+
+String::data const* String::data::create(Char_t c, int n)
+{
+    assert(n >= 0);
+
+    if (c != '\0' && n > 0)
+    {
+        return new StrRep(c, n);
+    }
+
+    PROFILER; return create();
+}
+
+// Small pieces are copied into one buffer rather than linked together, because below a few cache lines the node and
+// its indirection cost more than the copy.  A piece with more than one reference is certain to stay alive after the
+// copy, so its bytes are only duplicated under a lower limit.  A single reference does not prove the opposite: the
+// operands of String(String const&, String const&) are still held by their own handles afterwards, and only an rvalue
+// operand, which grow() gives up, is actually freed by the copy.  A tree that has grown too deep is flattened
+// regardless.
+
+std::atomic<size_t> String::data::nBufferLimit{ 128 };
+std::atomic<size_t> String::data::nSharedLimit{ 32 };
+
+bool String::data::coalesce(data const* p, data const* q) noexcept
+{
+    assert(p && q);
+
+    if (std::max(p->depth(), q->depth()) >= STACK_LIMIT) { PROFILER; return true; }
+
+    if (!p->size() || !q->size()) { PROFILER; return false; }
+
+    auto n = p->size() + q->size();
+    if (n > nBufferLimit.load(std::memory_order_relaxed)) return false;
+    if (p->IsShared() || q->IsShared()) return n <= nSharedLimit.load(std::memory_order_relaxed);
+
+    return true;
+}
+
+void String::data::limit(size_t nBuffer, size_t nShared) noexcept
+{
+    nBufferLimit.store(nBuffer, std::memory_order_relaxed);
+    nSharedLimit.store(std::min(nShared, nBuffer), std::memory_order_relaxed);
+}
+
+// The hash of a concatenation is folded from the hashes of its children and kept, and that of any other node is
+// computed from its bytes whenever it is asked for.  Concurrent first uses compute the same value, so the cache needs
+// no ordering.
+
+uint64_t String::data::hash() const noexcept
+{
+    auto q = folded();
+    if (!q) return digest();
+
+    auto result = q->nHash.load(std::memory_order_relaxed);
+    if (result & HASH_READY) return result & ~HASH_READY;
+
+    result = digest();
+    q->nHash.store(result | HASH_READY, std::memory_order_relaxed);
+    return result;
+}
+
+bool String::data::hashed(uint64_t& n) const noexcept
+{
+    auto q = folded();
+    if (!q) return false;
+
+    auto result = q->nHash.load(std::memory_order_relaxed);
+    n = result & ~HASH_READY;
+    return (result & HASH_READY) != 0;
+}
+
+uint64_t String::data::power() const noexcept
+{
+    auto q = folded();
+    if (!q) return hash_power(size());
+
+    auto result = q->nPower.load(std::memory_order_relaxed);
+    if (result) return result;
+
+    result = 1;
+    for (int i = 0, k = count(); i < k; ++i) result = hash_mul(result, child(i)->power());
+
+    q->nPower.store(result, std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t String::data::digest() const noexcept
+{
+    if (auto k = count())
+    {
+        uint64_t result = 0;
+        for (int i = 0; i < k; ++i) result = hash_add(hash_mul(result, child(i)->power()), child(i)->hash());
+        return result;
+    }
+
+    if (auto p = span()) return hash_bytes(p, size());
+
+    assert(!size());
+    PROFILER; return 0;
+}
+
+// Pieces that are neither StrCat nor StrSum are collected side by side into one StrSum of up to SUM_LIMIT children,
+// and only full StrSum nodes become the leaves of the balanced StrCat tree.
+
+String::data const* String::data::join(data const* p, data const* q)
+{
+    assert(p && q);
+
+    if (!p->size()) { PROFILER; return Clone(q); }
+    if (!q->size()) { PROFILER; return Clone(p); }
+    if (StrSum::width(p) + StrSum::width(q) > StrSum::SUM_LIMIT) { return StrCat::balance(p, q); }
+
+    return new StrSum(p, q);
+}
+
+// Concatenates any number of strings in one step.  Up to the coalescing limit they are copied into one buffer, and
+// otherwise their nodes become the children of one StrSum, or of a balanced tree of them if there are too many.  The
+// strings stay alive in their holders, so neighbours of up to the shared limit each are copied together into one
+// buffer, as coalesce() would, rather than each getting a node of its own.
+
+String::data const* String::data::concat(String const* const* p, size_t n)
+{
+    assert(p || !n);
+
+    size_t nSize = 0;
+    for (size_t i = 0; i < n; ++i) nSize += p[i]->Size();
+
+    if (!nSize) { PROFILER; return create(); }
+    if (nSize <= nBufferLimit.load(std::memory_order_relaxed)) return new(nSize) StrBuf(p, n, nSize);
+
+    auto const nSmall = std::max(nSharedLimit.load(std::memory_order_relaxed), size_t(INLINE_LIMIT));
+    Refs v;
+
+    v.reserve(n);
+
+    for (size_t i = 0, j; i < n; i = j)
+    {
+        size_t m = 0;
+
+        for (j = i; j < n && p[j]->Size() <= nSmall; ++j) m += p[j]->Size();
+
+        if (j == i) { v.push_back(p[j++]->node()); continue; }
+        if (!m) continue;
+
+        if (j - i == 1 && !p[i]->isInline()) v.push_back(p[i]->node());
+        else v.push_back(new(m) StrBuf(p + i, j - i, m));
+    }
+
+    if (v.size() == 2) { auto q = new StrCat(v[0], v[1]); v.clear(); return q; }  // Pooled, unlike the vector of a StrSum
+    if (v.size() > 2 && v.size() <= StrSum::SUM_LIMIT) return new StrSum(std::move(v));
+
+    return link(v.data(), v.size());
+}
+
+// Links n nonempty nodes together in order, as the children of one StrSum, or by halving the range until they fit.
+// The nodes are taken as they are, without looking inside concatenations, which keeps this free of dynamic casts.
+
+String::data const* String::data::link(data const* const* p, size_t n)
+{
+    assert(p && n);
+
+    if (n == 1) return Clone(p[0]);
+
+    if (n <= StrSum::SUM_LIMIT)
+    {
+        Refs v;
+
+        v.reserve(n);
+        for (size_t i = 0; i < n; ++i) v.push_back(Clone(p[i]));
+        return new StrSum(std::move(v));
+    }
+
+    Refs v;
+
+    v.reserve(2);
+    v.push_back(link(p, n / 2));
+    v.push_back(link(p + n / 2, n - n / 2));
+    return join(v[0], v[1]);
+}
+
+// Takes over the reference to p, and returns one to p followed, or preceded, by q.  A node that nobody else holds is
+// grown in place when it can be.
+
+String::data const* String::data::grow(data const* p, data const* q, bool bFront)
+{
+    assert(p && q);
+
+    if (enlarge(p, q, bFront)) return p;
+
+    auto r = bFront ? q->append(p) : p->append(q);
+
+    Erase(p);
+    return r;
+}
+
+bool String::data::growable(data const* p) noexcept
+{
+    assert(p);
+    return !p->IsShared() && !p->IsPublished();
+}
+
+// Nothing else can see a node that nobody else holds, so it may change, but what it had cached about its contents has
+// to go.
+
+bool String::data::enlarge(data const* p, data const* q, bool bFront)
+{
+    assert(p && q);
+
+    if (!growable(p) || !const_cast<data*>(p)->extend(q, bFront)) return false;
+
+    if (auto r = p->folded())
+    {
+        r->nHash.store(0, std::memory_order_relaxed);
+        r->nPower.store(0, std::memory_order_relaxed);
+    }
+
+    if (auto r = p->flattened()) { if (r->nFlat.load(std::memory_order_acquire) != FLAT_NONE) detach(r); }
+
+    return true;
+}
+
+// Copies the leaves left to right straight into the destination.  The path down to the current leaf is kept in a frame
+// stack of fixed size rather than on the call stack, and a subtree that lies deeper than that, which a balanced tree
+// never has, is flattened by a nested call, so that neither the depth of the rope nor a lack of memory matters.
+
+void String::data::flatten(data const* p, char* q, size_t n) noexcept
+{
+    assert(p && q);
+
+    struct Frame
+    {
+        data const* p;
+        int nNext;   // Child to go down to next
+        int nCount;
+    };
+
+    Frame stack[FLATTEN_DEPTH];
+    int nTop = 0;
+
+    for (auto r = p; n; )
+    {
+        auto k = r->count();
+
+        if (k && nTop < FLATTEN_DEPTH)
+        {
+            stack[nTop++] = { r, 1, k };
+            r = r->child(0);
+            continue;
+        }
+
+        if (auto m = std::min(n, r->size()))
+        {
+            if (k) { PROFILER; flatten(r, q, m); }
+            else r->get(q, m);
+
+            q += m;
+            n -= m;
+        }
+
+        while (nTop && stack[nTop - 1].nNext == stack[nTop - 1].nCount) --nTop;
+        if (!nTop) break;
+
+        auto& top = stack[nTop - 1];
+        r = top.p->child(top.nNext++);
+    }
+
+    if (n) memset(q, '\0', n);
+}
+
+// Reads through 'read(p, n)', which returns 0 at the end of the input, and builds one leaf per READ_CHUNK bytes.  The
+// bytes of a UTF-8 sequence that is cut off by the end of a chunk are carried over to the next one.
+
+template <typename F> String::data const* String::data::read_all(F&& read)
+{
+    std::vector<char> buffer(READ_CHUNK + 1);
+    auto p = create();
+    size_t nCarry = 0;
+
+    try
+    {
+        for (bool bEnd = false; !bEnd; )
+        {
+            auto nFill = nCarry;
+
+            while (nFill < READ_CHUNK)
+            {
+                auto n = read(buffer.data() + nFill, READ_CHUNK - nFill);
+                if (!n) { bEnd = true; break; }
+                nFill += n;
+            }
+
+            nCarry = bEnd ? 0 : UTF8_incomplete(buffer.data(), nFill);
+
+            if (auto n = nFill - nCarry)
+            {
+                auto c = buffer[n];
+
+                buffer[n] = '\0';
+                data const* q = new(n) StrBuf(buffer.data(), n);
+                buffer[n] = c;
+
+                auto r = p->append(q);
+
+                Erase(p);
+                Erase(q);
+                p = r;
+
+                memmove(buffer.data(), buffer.data() + n, nCarry);
+            }
+        }
+    }
+    catch (...)
+    {
+        Erase(p);
+        throw;
+    }
+
+    return p;
+}
+
+char const* String::data::evaluate(data const*& p)
+{
+    assert(p);
+
+    auto result = p->buffer();
+    if (result) return result;
+
+    // Other threads may be reading the same handle of a published node, so its copy stays in the node, whereas an
+    // unpublished handle moves over to the copy, and the node goes away once the last of its holders has done the same.
+
+    auto r = p->flattened();
+    assert(r);
+
+    if (r->nFlat.load(std::memory_order_acquire) == FLAT_PINNED) return r->pFlat.load(std::memory_order_relaxed)->buffer();
+    if (p->IsPublished()) return pin(p, r);
+
+    auto q = p->IsShared() || r->nFlat.load(std::memory_order_relaxed) != FLAT_NONE ? attached(p, r) : nullptr;
+    if (!q) q = new(p->size(), true) StrBuf(p);
+
+    Erase(p);
+    p = q;
+    return p->buffer();
+}
+
+/***********************************************************************************************************************
+*** Flat copies
+***********************************************************************************************************************/
+
+// A node that is also held from elsewhere keeps its flat copy, so that its other holders find it ready, and the copy is
+// listed here, least recently handed out first.  When the copies hold more bytes than the budget, the oldest are dropped
+// from their nodes.  Each handle that has taken a copy holds a reference to it, so dropping it only costs the next
+// holder of the node a flatten.  A published node is different, since the threads that read its handle use the copy in
+// place, so its copy is pinned to it for as long as the node lives, and not listed.  Everything here is behind one lock,
+// which a handle only takes on its way to a flat copy.  Nodes are known by their Flattened, which is where they keep
+// the copy.
+
+struct String::data::Memo final
+{
+    struct Listed
+    {
+        Flattened const* pNode;
+        data const* pCopy;  // Only set once the copy has been dropped from the node, see trim()
+    };
+
+    std::mutex lock;
+    std::list<Listed> order;  // Nodes with a listed copy, least recently used first
+    std::unordered_map<Flattened const*, std::list<Listed>::iterator> where;
+    size_t nBytes = 0;        // In all the attached copies, pinned ones too
+    size_t nBudget = size_t(64) << 20;
+
+    // Never destroyed, like the pools, since nodes may still go away during static destruction.
+
+    static Memo& instance() { static auto p = new Memo; return *p; }
+
+    // Dropped copies are moved over to a list of the caller's along with their entries, so that dropping needs no
+    // memory, and they are only released after the lock has been let go of, since that may delete nodes.
+
+    void trim(Flattened const* pKeep, std::list<Listed>& dropped) noexcept
+    {
+        while (nBytes > nBudget && !order.empty() && order.front().pNode != pKeep)
+        {
+            auto p = order.front().pNode;
+            auto q = p->pFlat.exchange(nullptr, std::memory_order_relaxed);
+
+            where.erase(p);
+            nBytes -= q->size();
+            order.front().pCopy = q;
+            dropped.splice(dropped.end(), order, order.begin());
+
+            // The last thing done to the node, which may be on its way out on another thread and waiting for the lock
+
+            p->nFlat.store(FLAT_NONE, std::memory_order_release);
+        }
+    }
+
+    static void erase(std::list<Listed>& dropped) noexcept
+    {
+        for (auto const& item : dropped) Erase(item.pCopy);
+        dropped.clear();
+    }
+
+    bool list(Flattened const* p) noexcept
+    {
+        try
+        {
+            order.push_back({ p, nullptr });
+            where.emplace(p, std::prev(order.end()));
+            return true;
+        }
+        catch (...)
+        {
+            if (!order.empty() && order.back().pNode == p) order.pop_back();
+            return false;
+        }
+    }
+
+    void touch(Flattened const* p) noexcept
+    {
+        auto it = where.find(p);
+        if (it != where.end()) order.splice(order.end(), order, it->second);
+    }
+
+    void unlist(Flattened const* p) noexcept
+    {
+        auto it = where.find(p);
+        if (it == where.end()) return;
+
+        order.erase(it->second);
+        where.erase(it);
+    }
+};
+
+char const* String::data::pin(data const* p, Flattened const* f)
+{
+    auto& memo = Memo::instance();
+    data const* q = nullptr;  // A copy made outside the lock, unless the node gets one meanwhile
+    std::list<Memo::Listed> dropped;
+    char const* result;
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> guard(memo.lock);
+            auto r = f->pFlat.load(std::memory_order_relaxed);
+
+            if (r || q)
+            {
+                if (!r)
+                {
+                    f->pFlat.store(r = q, std::memory_order_relaxed);
+                    memo.nBytes += r->size();
+                    memo.trim(nullptr, dropped);
+                    q = nullptr;
+                }
+                else if (f->nFlat.load(std::memory_order_relaxed) == FLAT_LISTED)
+                {
+                    memo.unlist(f);
+                }
+
+                f->nFlat.store(FLAT_PINNED, std::memory_order_release);
+                result = r->buffer();
+                break;
+            }
+        }
+
+        q = new(p->size(), true) StrBuf(p);
+    }
+
+    Erase(q);
+    Memo::erase(dropped);
+    return result;
+}
+
+// New reference to the flat copy of an unpublished node, which the node gets if it is shared and the copy fits in the
+// budget, or nullptr for a node that neither has nor gets one.
+
+String::data const* String::data::attached(data const* p, Flattened const* f)
+{
+    auto& memo = Memo::instance();
+    data const* q = nullptr;  // A copy made outside the lock
+    data const* result = nullptr;
+    std::list<Memo::Listed> dropped;
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> guard(memo.lock);
+
+            if (auto r = f->pFlat.load(std::memory_order_relaxed))
+            {
+                memo.touch(f);
+                result = Clone(r);
+                break;
+            }
+
+            if (q && p->IsShared() && q->size() <= memo.nBudget && memo.list(f))
+            {
+                f->pFlat.store(Clone(q), std::memory_order_relaxed);
+                f->nFlat.store(FLAT_LISTED, std::memory_order_release);
+                memo.nBytes += q->size();
+                memo.trim(f, dropped);
+            }
+
+            if (q || !p->IsShared() || p->size() > memo.nBudget)
+            {
+                std::swap(q, result);
+                break;
+            }
+        }
+
+        q = new(p->size(), true) StrBuf(p);
+    }
+
+    Erase(q);
+    Memo::erase(dropped);
+    return result;
+}
+
+void String::data::detach(Flattened const* p) noexcept
+{
+    auto& memo = Memo::instance();
+    data const* q;
+    {
+        std::lock_guard<std::mutex> guard(memo.lock);
+
+        if (p->nFlat.load(std::memory_order_relaxed) == FLAT_LISTED) memo.unlist(p);
+
+        q = p->pFlat.exchange(nullptr, std::memory_order_relaxed);
+        if (q) memo.nBytes -= q->size();
+
+        p->nFlat.store(FLAT_NONE, std::memory_order_relaxed);
+    }
+
+    Erase(q);
+}
+
+void String::data::budget(size_t n)
+{
+    auto& memo = Memo::instance();
+    std::list<Memo::Listed> dropped;
+    {
+        std::lock_guard<std::mutex> guard(memo.lock);
+
+        memo.nBudget = n;
+        memo.trim(nullptr, dropped);
+    }
+
+    Memo::erase(dropped);
+}
+
+/***********************************************************************************************************************
+*** String::Walk
+***********************************************************************************************************************/
+
+// One side of a comparison: the subtrees not visited yet, and the unread bytes of the current piece.  Unlike a Span, a
+// walk opens one node at a time, so that a subtree both sides have in common is found wherever the two trees are cut.
+
+struct String::Walk final
+{
+    explicit Walk(String const& r) : pFill(nullptr), nFill(0)
+    {
+        if (r.isInline()) view = std::string_view(r.cInline, r.tag() & 0x0F); else stack.push_back(r.pData);
+    }
+
+    Walk(char const* p, size_t n) : pFill(nullptr), nFill(0), view(p, n) { }
+
+    static int compare(Walk&, Walk&);
+
+private:
+    bool boundary() const noexcept { return view.empty() && !pFill; }
+    data const* top() const noexcept { return stack.empty() ? nullptr : stack.back(); }
+
+    void step();
+    void advance();
+    void fill() noexcept;
+
+    std::vector<data const*> stack;  // Subtrees not visited yet, the next one on top
+    data const* pFill;               // Leaf without bytes of its own that is being produced in chunks
+    int nFill;
+    std::string_view view;
+    char cChunk[256];
+};
+
+// Between pieces on both sides, the same node on top of both stacks is skipped unread.  Otherwise the larger of the two
+// is opened, so that a subtree nested deeper on one side still comes up to meet its twin.
+
+int String::Walk::compare(Walk& a, Walk& b)
+{
+    for (;;)
+    {
+        if (a.boundary() && b.boundary())
+        {
+            auto p = a.top();
+            auto q = b.top();
+
+            if (!p || !q)
+            {
+                a.advance();
+                b.advance();
+                return a.view.empty() ? b.view.empty() ? 0 : -1 : 1;
+            }
+
+            if (p == q)
+            {
+                a.stack.pop_back();
+                b.stack.pop_back();
+                continue;
+            }
+
+            if (p->size() >= q->size()) a.step(); else b.step();
+            continue;
+        }
+
+        if (a.view.empty()) { a.advance(); if (a.view.empty()) return -1; continue; }
+        if (b.view.empty()) { b.advance(); if (b.view.empty()) return 1; continue; }
+
+        auto n = std::min(a.view.size(), b.view.size());
+
+        if (a.view.data() != b.view.data())
+        {
+            if (auto c = memcmp(a.view.data(), b.view.data(), n)) return c < 0 ? -1 : 1;
+        }
+
+        a.view.remove_prefix(n);
+        b.view.remove_prefix(n);
+    }
+}
+
+// Replaces the node on top of the stack with its children, or makes it the current piece if it is a leaf.
+
+void String::Walk::step()
+{
+    auto p = stack.back();
+
+    stack.pop_back();
+
+    if (auto k = p->count())
+    {
+        while (k--) stack.push_back(p->child(k));
+        return;
+    }
+
+    if (!p->size()) { PROFILER; return; }
+
+    if (auto q = p->span())
+    {
+        view = std::string_view(q, p->size());
+        return;
+    }
+
+    pFill = p;
+    nFill = 0;
+    fill();
+}
+
+void String::Walk::advance()
+{
+    if (pFill) { fill(); return; }
+    while (view.empty() && !pFill && !stack.empty()) step();
+}
+
+void String::Walk::fill() noexcept
+{
+    assert(pFill && nFill < pFill->length());
+
+    size_t n = 0;
+
+    while (nFill < pFill->length() && n + 8 <= sizeof cChunk) n += UTF8_put(cChunk + n, pFill->at(nFill++));
+    if (nFill == pFill->length()) pFill = nullptr;
+
+    view = std::string_view(cChunk, n);
+}
+
+/***********************************************************************************************************************
+*** Search
+***********************************************************************************************************************/
+
+// Calls f(piece, length) with the contiguous pieces of a rope, left to right or right to left, until it returns false.
+// Repeated characters are produced in chunks from a local buffer.
+
+template <typename F> void pieces(String::data const* p, bool bReverse, F&& f)
+{
+    std::vector<String::data const*> stack{ p };
+    char cChunk[256];
+
+    while (!stack.empty())
+    {
+        auto q = stack.back();
+
+        stack.pop_back();
+
+        if (auto k = q->count())
+        {
+            if (bReverse) for (int i = 0; i < k; ++i) stack.push_back(q->child(i)); else while (k--) stack.push_back(q->child(k));
+            continue;
+        }
+
+        if (!q->size()) { PROFILER; continue; }
+
+        if (auto r = q->span())
+        {
+            if (!f(std::string_view(r, q->size()), q->length())) return;
+            continue;
+        }
+
+        auto const nStep = int(sizeof cChunk / 8);
+
+        for (int i = 0; i < q->length(); i += nStep)
+        {
+            auto k = std::min(nStep, q->length() - i);
+            size_t n = 0;
+
+            for (int j = 0; j < k; ++j) n += UTF8_put(cChunk + n, q->at(bReverse ? q->length() - i - k + j : i + j));
+            if (!f(std::string_view(cChunk, n), k)) return;
+        }
+    }
+}
+
+// Feeds a haystack to a pattern piece by piece in the direction of the search, carrying the state of the search from
+// piece to piece, so that the whole search stays linear however short the pieces are.  The windows that straddle pieces
+// are searched in a buffer that holds the bytes from the first of them on, in the order of the search, to which each
+// piece adds no more than its first bytes, one less than the needle, and they come before any window within the piece.
+
+struct Search final
+{
+    Search(Pattern const& r, bool bReverse, int nLength) noexcept : pattern(r), bReverse(bReverse), nLength(nLength), nDone(0), nResult(-1),
+        nStart(0), nSkip(0), nMemory(-1) { }
+
+    bool next(std::string_view, int);  // True once a match has been found
+    int result() const noexcept { return nResult; }
+
+private:
+    Pattern const& pattern;
+    bool const bReverse;
+    int const nLength;    // Of the whole haystack
+    int nDone;            // Code points in the pieces seen so far
+    int nResult;
+    std::string buffer;   // Bytes from the next window on, at nStart, when it straddles pieces
+    size_t nStart;
+    ptrdiff_t nSkip;      // Bytes of the next pieces before the next window, when the buffer is empty
+    ptrdiff_t nMemory;    // See Pattern
+};
+
+bool Search::next(std::string_view v, int n)
+{
+    ptrdiff_t const m = pattern.size();
+    ptrdiff_t const nSize = v.size();
+    ptrdiff_t j = nSkip;
+
+    if (nStart < buffer.size())
+    {
+        ptrdiff_t const e = buffer.size() - nStart;  // Where the piece starts, from the next window
+        auto k = std::min(nSize, m - 1);
+
+        if (bReverse) buffer.append(std::make_reverse_iterator(v.end()), std::make_reverse_iterator(v.end() - k));
+        else buffer.append(v.data(), k);
+
+        j = 0;
+
+        auto i = pattern.resume(buffer.data() + nStart, buffer.size() - nStart, j, nMemory, e);
+
+        if (i != Pattern::npos)
+        {
+            nResult = bReverse ? nLength - nDone - UTF8_length(v.data() + nSize - (i + m - e), i + m - e) : nDone - UTF8_length(buffer.data() + nStart + i, e - i);
+            return true;
+        }
+
+        if (j < e)
+        {
+            // The whole piece is in the buffer, and the bytes before the next window go once they are the larger part.
+
+            assert(k == nSize);
+
+            nStart += j;
+            if (nStart > buffer.size() / 2) { buffer.erase(0, nStart); nStart = 0; }
+
+            nDone += n;
+            return false;
+        }
+
+        buffer.clear();
+        nStart = 0;
+        j -= e;
+    }
+
+    auto i = pattern.scan(v.data(), nSize, j, nMemory);
+
+    if (i != Pattern::npos)
+    {
+        nResult = bReverse ? nLength - nDone - UTF8_length(v.data() + nSize - i - m, i + m) : nDone + UTF8_length(v.data(), i);
+        return true;
+    }
+
+    nDone += n;
+    nSkip = std::max<ptrdiff_t>(j - nSize, 0);
+
+    if (j < nSize)
+    {
+        if (bReverse) buffer.assign(std::make_reverse_iterator(v.end() - j), v.rend());
+        else buffer.assign(v.data() + j, nSize - j);
+    }
+
+    return false;
+}
+
+/***********************************************************************************************************************
+*** String
+***********************************************************************************************************************/
+
+String::String()
+{
+    store("", 0, 0);
+}
+
+String::String(String const& r)
+{
+    if (!r.isInline()) Shared::Clone(r.pData);
+    memcpy(cInline, r.cInline, sizeof cInline);
+}
+
+String::String(String&& r) noexcept
+{
+    memcpy(cInline, r.cInline, sizeof cInline);
+    r.store("", 0, 0);
+}
+
+String::String(String const& r, String const& s)
+{
+    if (r.isInline() && s.isInline() && size_t((r.tag() & 0x0F) + (s.tag() & 0x0F)) <= INLINE_LIMIT)
+    {
+        char c[INLINE_LIMIT];
+        size_t n = r.tag() & 0x0F;
+
+        memcpy(c, r.cInline, n);
+        memcpy(c + n, s.cInline, s.tag() & 0x0F);
+        store(c, n + (s.tag() & 0x0F), (r.tag() >> 4) + (s.tag() >> 4));
+        return;
+    }
+
+    auto p = r.isInline() ? r.node() : r.pData;
+    auto q = s.isInline() ? s.node() : s.pData;
+
+    adopt(p->append(q));
+
+    if (p != r.pData) Shared::Erase(p);
+    if (q != s.pData) Shared::Erase(q);
+}
+
+// The result is built in a local string and moved in at the end, because a constructor that throws does not run the
+// destructor, and the node taken over from the rvalue would leak if extend() threw.
+
+String::String(String&& r, String const& s)
+{
+    store("", 0, 0);
+    if (&r == &s) { *this = String(static_cast<String const&>(r), s); return; }
+
+    String result(std::move(r));
+
+    result.extend(s, false);
+    *this = std::move(result);
+}
+
+String::String(String const& r, String&& s)
+{
+    store("", 0, 0);
+    if (&r == &s) { *this = String(r, static_cast<String const&>(s)); return; }
+
+    String result(std::move(s));
+
+    result.extend(r, true);
+    *this = std::move(result);
+}
+
+// The node that can grow takes in the other operand, the left one if both can.
+
+String::String(String&& r, String&& s)
+{
+    store("", 0, 0);
+    if (&r == &s) { *this = String(static_cast<String const&>(r), s); return; }
+
+    auto bFront = (r.isInline() || !String::data::growable(r.pData)) && !s.isInline() && String::data::growable(s.pData);
+    String result(std::move(bFront ? s : r));
+
+    result.extend(bFront ? r : s, bFront);
+    *this = std::move(result);
+}
+
+String::String(String const& r, int n)
+{
+    if (n <= 0) { store("", 0, 0); return; }
+
+    if (r.isInline())
+    {
+        n = std::min(n, r.tag() >> 4);
+        store(r.cInline, UTF8_size(r.cInline, r.tag() & 0x0F, n), n);
+        return;
+    }
+
+    if (n < r.pData->length())
+    {
+        auto m = r.pData->size(n);
+
+        if (m <= INLINE_LIMIT)
+        {
+            char c[INLINE_LIMIT];
+
+            r.pData->get(c, m);
+            store(c, m, n);
+            return;
+        }
+    }
+
+    adopt(r.pData->head(n));
+}
+
+// Copies the last m bytes of a rope, which start at a code point, from the pieces they lie in.
+
+void tail_bytes(String::data const* p, char* c, size_t m) noexcept
+{
+    if (auto k = p->count())
+    {
+        while (m)
+        {
+            auto q = p->child(--k);
+            auto i = std::min(m, q->size());
+
+            tail_bytes(q, c + m - i, i);
+            m -= i;
+        }
+
+        return;
+    }
+
+    if (auto r = p->span()) memcpy(c, r + p->size() - m, m);
+    else p->get(c, m);  // Repeated characters, which end with the bytes they start with
+}
+
+String::String(int n, String const& r)
+{
+    n = std::max(n, 0);
+
+    if (r.isInline())
+    {
+        n = std::min(n, r.tag() >> 4);
+
+        auto m = UTF8_size(r.cInline, r.tag() & 0x0F, n);
+
+        store(r.cInline + m, (r.tag() & 0x0F) - m, (r.tag() >> 4) - n);
+        return;
+    }
+
+    if (n == 0) { adopt(Shared::Clone(r.pData)); return; }
+
+    auto length = r.pData->length();
+
+    if (n >= length) { store("", 0, 0); return; }
+
+    auto m = r.pData->size() - r.pData->size(n);
+
+    if (m <= INLINE_LIMIT)
+    {
+        char c[INLINE_LIMIT];
+
+        tail_bytes(r.pData, c, m);
+        store(c, m, length - n);
+        return;
+    }
+
+    adopt(r.pData->tail(n));
+}
+
+String::String(char const* p)
+{
+    auto n = p ? strlen(p) : 0;
+
+    if (n <= INLINE_LIMIT) { store(p ? p : "", n, UTF8_length(p ? p : "", n)); return; }
+
+    adopt(String::data::create(p, n));
+}
+
+String::String(Literal const& r)
+{
+    if (!r.nSize) { store("", 0, 0); return; }
+
+    adopt(StrLit::create(r));
+}
+
+String::String(Char_t c, int n)
+{
+    if (c == '\0' || n <= 0) { store("", 0, 0); return; }
+
+    auto k = char_size(c);
+
+    if (size_t(n) <= INLINE_LIMIT / k)
+    {
+        char b[INLINE_LIMIT];
+
+        for (int i = 0; i < n; ++i) UTF8_put(b + i * k, c);
+        store(b, n * k, n);
+        return;
+    }
+
+    adopt(String::data::create(c, n));
+}
+
+String::~String()
+{
+    if (!isInline()) Shared::Erase(pData);
+}
+
+String& String::operator=(String const& r)
+{
+    if (!r.isInline()) Shared::Clone(r.pData);
+    if (!isInline()) Shared::Erase(pData);
+    memmove(cInline, r.cInline, sizeof cInline);
+    return *this;
+}
+
+String& String::operator=(String&& r) noexcept
+{
+    if (&r != this)
+    {
+        if (!isInline()) Shared::Erase(pData);
+        memcpy(cInline, r.cInline, sizeof cInline);
+        r.store("", 0, 0);
+    }
+
+    return *this;
+}
+
+String& String::operator+=(String const& r)
+{
+    if (&r == this) { String s(r); extend(s, false); return *this; }
+
+    extend(r, false);
+    return *this;
+}
+
+void String::Publish() const
+{
+    if (!isInline()) Shared::Publish(pData);
+}
+
+String String::FromFile(char const* szPath, unsigned long long nOffset, size_t nSize)
+{
+    auto p = StrMap::create(szPath, nOffset, nSize);
+    return p ? from(p) : String();
+}
+
+String String::Read(int fd)
+{
+    return from(String::data::read_all([fd](char* p, size_t n) -> size_t
+    {
+        for (;;)
+        {
+#if defined(_WIN32)
+            auto r = _read(fd, p, unsigned(std::min<size_t>(n, INT_MAX)));
+#else
+            auto r = ::read(fd, p, n);
+#endif
+            if (r >= 0) return size_t(r);
+            if (errno != EINTR) throw "String::Read(): Reading from the file descriptor failed.";
+        }
+    }));
+}
+
+String String::Read(std::istream& r)
+{
+    return from(String::data::read_all([&r](char* p, size_t n) -> size_t
+    {
+        r.read(p, std::streamsize(n));
+        if (r.bad()) throw "String::Read(): Reading from the stream failed.";
+        return size_t(r.gcount());
+    }));
+}
+
+void String::Coalesce(size_t nLimit, size_t nSharedLimit)
+{
+    String::data::limit(nLimit, nSharedLimit);
+}
+
+void String::Memoize(size_t nBudget)
+{
+    String::data::budget(nBudget);
+}
+
+void String::Intern(size_t nLimit)
+{
+    Interned::limit(nLimit > INLINE_LIMIT ? nLimit : 0);
+}
+
+String::operator char const* () const
+{
+    return isInline() ? cInline : String::data::evaluate(pData);
+}
+
+std::string_view String::View() const
+{
+    if (isInline()) return std::string_view(cInline, tag() & 0x0F);
+    if (auto p = pData->span()) return std::string_view(p, pData->size());
+
+    PROFILER;
+    auto p = String::data::evaluate(pData);
+    return std::string_view(p, pData->size());
+}
+
+void String::Get(char* p, size_t n) const
+{
+    if (!isInline()) return pData->get(p, n);
+
+    assert(p && n);
+
+    memcpy(p, cInline, std::min(n, INLINE_LIMIT + 1));
+    if (n > INLINE_LIMIT + 1) memset(p + INLINE_LIMIT + 1, '\0', n - INLINE_LIMIT - 1);
+}
+
+#if defined(_WIN32)
+
+bool String::WriteTo(int fd) const
+{
+    for (auto const& piece : Spans())
+    {
+        for (auto p = piece.data(), q = p + piece.size(); p < q; )
+        {
+            auto r = _write(fd, p, unsigned(std::min<size_t>(q - p, INT_MAX)));
+            if (r < 0) return false;
+            p += r;
+        }
+    }
+
+    return true;
+}
+
+#else
+
+#if defined(IOV_MAX)
+int const IOV_BATCH = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+int const IOV_BATCH = 16;
+#endif
+
+// Leaves are gathered into an iovec batch and handed to writev().  Pieces that only exist in the chunk buffer of the
+// span iterator (repeated characters) are copied into a local fill buffer first, because the next step overwrites the
+// chunk; consecutive such pieces share one iovec.
+
+bool String::WriteTo(int fd) const
+{
+    iovec batch[IOV_BATCH];
+    char cFill[4096];
+    int nBatch = 0;
+    size_t nFill = 0;
+
+    auto flush = [&]() -> bool
+    {
+        auto p = batch;
+        auto n = nBatch;
+
+        while (n)
+        {
+            auto r = writev(fd, p, n);
+
+            if (r < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            for (; n && size_t(r) >= p->iov_len; --n) r -= (p++)->iov_len;
+
+            if (n)
+            {
+                PROFILER;
+                p->iov_base = static_cast<char*>(p->iov_base) + r;
+                p->iov_len -= r;
+            }
+        }
+
+        nBatch = 0;
+        nFill = 0;
+        return true;
+    };
+
+    for (auto it = Spans(); it != it.end(); ++it)
+    {
+        auto p = it->data();
+        auto n = it->size();
+
+        if (nBatch == IOV_BATCH && !flush()) return false;
+
+        if (p == it.cChunk)
+        {
+            if (nFill + n > sizeof cFill && !flush()) return false;
+
+            memcpy(cFill + nFill, p, n);
+            p = cFill + nFill;
+            nFill += n;
+
+            if (nBatch && static_cast<char*>(batch[nBatch - 1].iov_base) + batch[nBatch - 1].iov_len == p)
+            {
+                batch[nBatch - 1].iov_len += n;
+                continue;
+            }
+        }
+
+        batch[nBatch].iov_base = const_cast<char*>(p);
+        batch[nBatch].iov_len = n;
+        ++nBatch;
+    }
+
+    return flush();
+}
+
+#endif
+
+int String::Length() const
+{
+    return isInline() ? tag() >> 4 : pData->length();
+}
+
+size_t String::Size() const
+{
+    return isInline() ? tag() & 0x0F : pData->size();
+}
+
+Char_t String::At(int n) const
+{
+    if (!isInline()) return pData->at(n);
+    if (n < 0 || n >= tag() >> 4) { PROFILER; return '\0'; }
+
+    return UTF8_char(cInline + UTF8_size(cInline, tag() & 0x0F, n));
+}
+
+int String::Depth() const
+{
+    return isInline() ? 0 : pData->depth();
+}
+
+size_t String::Hash() const
+{
+    return size_t(isInline() ? hash_bytes(cInline, tag() & 0x0F) : pData->hash());
+}
+
+int String::Compare(String const& r) const
+{
+    if (!isInline() && !r.isInline() && pData == r.pData) { PROFILER; return 0; }
+
+    Walk a(*this), b(r);
+    return Walk::compare(a, b);
+}
+
+int String::Compare(char const* p) const
+{
+    assert(p);
+
+    Walk a(*this), b(p, strlen(p));
+    return Walk::compare(a, b);
+}
+
+bool String::Equals(String const& r) const
+{
+    if (isInline() && r.isInline()) return !memcmp(cInline, r.cInline, sizeof cInline);
+
+    if (!isInline() && !r.isInline())
+    {
+        if (pData == r.pData) { PROFILER; return true; }
+        if (pData->size() != r.pData->size()) return false;
+
+        uint64_t m, n;
+        if (pData->hashed(m) && r.pData->hashed(n) && m != n) return false;
+    }
+    else if (Size() != r.Size()) return false;
+
+    Walk a(*this), b(r);
+    return !Walk::compare(a, b);
 }
 
-String::data const* StrCat::head(int n) const
+bool String::Equals(char const* p) const
 {
-    if (n <= 0) { PROFILER; return create(); }
-    if (n < pHead->length()) { return pHead->head(n); }
-    if (n == pHead->length()) { return Clone(pHead); }
+    assert(p);
 
-    if (n < length())
-    {
-        auto step0 = pTail->head(n - pHead->length());
-        auto step1 = pHead->append(step0);
+    auto n = strlen(p);
+    if (n != Size()) return false;
 
-        Erase(step0);
+    Walk a(*this), b(p, n);
+    return !Walk::compare(a, b);
+}
 
-        return step1;
-    }
+// The needle is copied out once, and the haystack is searched in place.
 
-    return Clone(this);
+int String::Find(String const& r, int nFrom) const
+{
+    nFrom = std::max(nFrom, 0);
+    if (nFrom > Length()) return -1;
+    if (nFrom) { auto n = Tail(nFrom).Find(r); return n < 0 ? n : n + nFrom; }
+
+    if (!r.Size()) { PROFILER; return 0; }
+    if (r.Size() > Size()) return -1;
+
+    return search(r, false);
 }
 
-String::data const* StrCat::tail(int n) const
+int String::RFind(String const& r) const
 {
-    if (n <= 0) { PROFILER; return Clone(this); }
+    if (!r.Size()) { PROFILER; return Length(); }
+    if (r.Size() > Size()) return -1;
 
-    if (n < pHead->length())
-    {
-        auto step0 = pHead->tail(n);
-        auto step1 = step0->append(pTail);
-        Erase(step0);
-        return step1;
-    }
+    return search(r, true);
+}
 
-    if (n == pHead->length()) { return Clone(pTail); }
-    if (n < length()) { return pTail->tail(n - pHead->length()); }
-    return create();
+bool String::Contains(String const& r) const
+{
+    return Find(r) >= 0;
 }
 
-String::data const* StrCat::prepend(String::data const* p) const
+int String::search(String const& r, bool bReverse) const
 {
-    assert(p);
+    std::string needle(r.Size() + 1, '\0');
+    r.Get(&needle[0], needle.size());
 
-    if (pTail->depth() > std::max(p->depth(), pHead->depth()))
-    {
-        auto step0 = p->append(pHead);
-        auto step1 = step0->append(pTail);
+    Pattern pattern(needle.data(), r.Size(), bReverse);
+    Search scan(pattern, bReverse, Length());
 
-        Erase(step0);
+    if (isInline()) scan.next(std::string_view(cInline, tag() & 0x0F), tag() >> 4);
+    else pieces(pData, bReverse, [&scan](std::string_view v, int n) { return !scan.next(v, n); });
 
-        return step1;
-    }
+    return scan.result();
+}
 
-    if (p->size() + size() <= BUFFER_LIMIT && std::max(p->depth(), depth()) >= STACK_LIMIT) { PROFILER; return new(p->size() + size()) StrBuf(p, this); }
-    return new StrCat(Clone(p), Clone(this));
+String::Cursor String::begin() const
+{
+    return isInline() ? Cursor(cInline, tag() & 0x0F, tag() >> 4, false) : Cursor(pData, false);
 }
 
-String::data const* StrCat::stretch(int n) const
+String::Cursor String::end() const
 {
-    auto step0 = pHead->stretch(n);
-    auto step1 = step0->append(pTail);
+    return isInline() ? Cursor(cInline, tag() & 0x0F, tag() >> 4, true) : Cursor(pData, true);
+}
 
-    Erase(step0);
+String::Span String::Spans() const
+{
+    return isInline() ? Span(cInline, tag() & 0x0F) : Span(pData);
+}
 
-    PROFILER; return step1;
+void String::store(char const* p, size_t n, int length) noexcept
+{
+    assert(p && n <= INLINE_LIMIT && length >= 0 && size_t(length) <= n);
+
+    memcpy(cInline, p, n);
+    memset(cInline + n, '\0', INLINE_LIMIT + 1 - n);
+    cInline[INLINE_LIMIT + 1] = char(length << 4 | n);
 }
 
-void StrCat::get(char* p, size_t n) const noexcept
+// Puts r after, or before, the contents of this string, which must not be r itself.
+
+void String::extend(String const& r, bool bFront)
 {
-    assert(p && n);
+    assert(&r != this);
+
+    if (!r.Size()) return;
+    if (isInline()) { *this = bFront ? String(r, *this) : String(*this, r); return; }
 
-    auto nHead = pHead->size();
+    auto p = r.isInline() ? r.node() : r.pData;
 
-    if (n > nHead)
+    try
     {
-        pHead->get(p, nHead);
-        pTail->get(p + nHead, n - nHead);
+        adopt(String::data::grow(pData, p, bFront));
     }
-    else
+    catch (...)
     {
-        pHead->get(p, n);
+        if (p != r.pData) Shared::Erase(p);
+        throw;
     }
+
+    if (p != r.pData) Shared::Erase(p);
 }
 
-Char_t StrCat::at(int n) const noexcept
+// Takes over a reference to a node, and keeps the contents inline instead if they are short enough.
+
+String String::from(data const* p)
 {
-    PROFILER; return n < pHead->length() ? pHead->at(n) : pTail->at(n - pHead->length());
+    assert(p);
+
+    auto n = p->size();
+    if (n > INLINE_LIMIT) return String(p);
+
+    String result;
+    char c[INLINE_LIMIT];
+
+    if (n) p->get(c, n);
+    result.store(c, n, p->length());
+    Shared::Erase(p);
+
+    return result;
 }
 
-size_t StrCat::size(int n) const noexcept
+String::data const* String::node() const
 {
-    if (n <= 0) { PROFILER; return 0; }
-    if (n < pHead->length()) { PROFILER; return pHead->size(n); }
-    if (n == pHead->length()) { PROFILER; return pHead->size(); }
-    if (n < length()) { PROFILER; return pHead->size() + pTail->size(n - pHead->length()); }
-    PROFILER; return size();
+    if (!isInline()) return Shared::Clone(pData);
+
+    size_t n = tag() & 0x0F;
+    return n ? new(n) StrBuf(cInline, n) : String::data::create();
 }
 
 /***********************************************************************************************************************
-*** StrSum
+*** String::Arena
 ***********************************************************************************************************************/
 
-String::data const* StrSum::append(String::data const* p) const
+String::Arena::Arena() noexcept : pOuter(pCurrentArena), pStore(nullptr)
 {
-    assert(p);
+    pCurrentArena = this;
+}
 
-    if (IsShared()) return p->prepend(this);
+String::Arena::~Arena()
+{
+    assert(pCurrentArena == this);
+    pCurrentArena = pOuter;
 
-    source.emplace_back(p);
-    nSize += p->size();
-    nLength += p->length();
-    pExtent = p->extent();
-    nDepth = std::max(nDepth, p->depth());
+    if (!pStore) return;
+    if (pStore->nLive.load(std::memory_order_relaxed) > 1) { WARN("Strings built in an arena outlived it"); }
 
-    return Clone(this);
+    pStore->release();
 }
 
 /***********************************************************************************************************************
-*** StrRep
+*** String::Cursor
 ***********************************************************************************************************************/
 
-String::data const* StrRep::append(String::data const* p) const
+String::Cursor::Cursor(data const* p, bool bEnd) : pRoot(Shared::Clone(p)), pLeaf(nullptr), pBegin(nullptr), pByte(nullptr), pEnd(nullptr), nOffset(0), nIndex(0)
 {
-    assert(p);
-    if (p->origin() == extent()) { return p->stretch(length()); }
-    return p->prepend(this);
+    if (bEnd) { nIndex = p->length(); return; }
+    if (p->length()) { enter(p, true); }
 }
 
-String::data const* StrRep::head(int n) const
+// The bytes of an inline string are one leaf without a node, so pLeaf stays null, and past the end pBegin and pEnd are
+// kept for stepping back.
+
+String::Cursor::Cursor(char const* p, size_t n, int length, bool bEnd) noexcept : pRoot(nullptr), pLeaf(nullptr), pBegin(p), pByte(bEnd || !n ? nullptr : p),
+    pEnd(p + n), nOffset(0), nIndex(bEnd ? length : 0)
 {
-    if (n <= 0) { PROFILER; return create(); }
-    if (n < length()) { return create(cData, n); }
-    return Clone(this);
 }
 
-String::data const* StrRep::tail(int n) const
+String::Cursor::Cursor(Cursor const& r) : pRoot(Shared::Clone(r.pRoot)), path(r.path), pLeaf(r.pLeaf), pBegin(r.pBegin), pByte(r.pByte), pEnd(r.pEnd), nOffset(r.nOffset), nIndex(r.nIndex)
 {
-    if (n <= 0) { PROFILER; return Clone(this); }
-    if (n < length()) { return create(cData, nLength - n); }
-    return create();
 }
 
-String::data const* StrRep::prepend(String::data const* p) const
+String::Cursor::~Cursor()
 {
-    assert(p);
-    if (p->size() + size() <= BUFFER_LIMIT && p->depth() >= STACK_LIMIT) { PROFILER; return new(p->size() + size()) StrBuf(p, this); }
-    return new StrCat(Clone(p), Clone(this));
+    Shared::Erase(pRoot);
 }
 
-String::data const* StrRep::stretch(int n) const
+String::Cursor& String::Cursor::operator=(Cursor const& r)
 {
-    assert(n > 0);
-    return create(cData, nLength + n);
+    Shared::Clone(r.pRoot);
+    Shared::Erase(pRoot);
+    pRoot = r.pRoot;
+    path = r.path;
+    pLeaf = r.pLeaf;
+    pBegin = r.pBegin;
+    pByte = r.pByte;
+    pEnd = r.pEnd;
+    nOffset = r.nOffset;
+    nIndex = r.nIndex;
+    return *this;
 }
 
-void StrRep::get(char* p, size_t n) const noexcept
+Char_t String::Cursor::get() const noexcept
 {
-    assert(p && n);
+    if (pByte) { return UTF8_char(pByte); }
+    if (pLeaf) { return pLeaf->at(nOffset); }
+    PROFILER; return '\0';
+}
 
-    if (n > nSize)
+// Descends from 'p' to its first (or last) leaf and positions the cursor on the first (or last) code point of it.
+
+void String::Cursor::enter(data const* p, bool bFirst)
+{
+    for (int n; (n = p->count()) > 0; p = p->child(path.back().second))
     {
-        memset(p, cData, nSize);
-        memset(p + nSize, '\0', n - nSize);
+        path.emplace_back(p, bFirst ? 0 : n - 1);
+    }
+
+    pLeaf = p;
+    pBegin = p->span();
+
+    if (pBegin)
+    {
+        pEnd = pBegin + p->size();
+        pByte = bFirst ? pBegin : pEnd - 1;
+        while (!bFirst && pByte > pBegin && (*pByte & 0xC0) == 0x80) --pByte;
     }
     else
     {
-        memset(p, cData, n);
+        pByte = pEnd = nullptr;
+        nOffset = bFirst ? 0 : p->length() - 1;
     }
 }
 
-Char_t StrRep::at(int n) const noexcept
+void String::Cursor::next() noexcept
 {
-    if (n < 0)
+    if (!pLeaf && !pByte) { PROFILER; return; }
+
+    ++nIndex;
+
+    if (pByte)
     {
-        PROFILER; return 0;
+        while (++pByte < pEnd && (*pByte & 0xC0) == 0x80);
+        if (pByte < pEnd) return;
+    }
+    else if (++nOffset < pLeaf->length())
+    {
+        return;
     }
 
-    if (n < nLength)
+    for (; !path.empty(); path.pop_back())
     {
-        PROFILER; return cData;
+        auto& top = path.back();
+        if (++top.second < top.first->count()) { enter(top.first->child(top.second), true); return; }
     }
 
-    PROFILER; return 0;
+    pLeaf = nullptr;
+    pByte = nullptr;
 }
 
-size_t StrRep::size(int n) const noexcept
+void String::Cursor::prev() noexcept
 {
-    if (n <= 0) { PROFILER; return 0; }
-    if (n < length()) { PROFILER; return char_size(cData) * n; }
-    PROFILER; return size();
-}
+    if (!nIndex) { PROFILER; return; }
 
-/***********************************************************************************************************************
-*** String::data
-***********************************************************************************************************************/
+    --nIndex;
 
-String::data const* String::data::create() noexcept
-{
-    static struct : public String::data
+    if (!pLeaf && !pByte)
     {
-    private:
-        data const* append(data const* p) const override final { assert(p); return Clone(p); }
-        data const* head(int) const override final { return Clone(this); }
-        data const* tail(int) const override final { return Clone(this); }
-        data const* prepend(data const* p) const override final { assert(p); return Clone(p); }
-        data const* stretch(int n) const override final { if (n) FAIL("An attempt was made to stretch an unstretchable string data object."); PROFILER; return Clone(this); }
-
-        void get(char* p, size_t n) const noexcept override final { assert(p && n); memset(p, '\0', n); }
-        Char_t at(int) const noexcept override final { PROFILER; return 0; }
-        size_t size(int) const noexcept override final { PROFILER; return 0; }
-        size_t size() const noexcept override final { PROFILER; return 0; }
-        int length() const noexcept override final { PROFILER; return 0; }
-
-        bool isASCII() const noexcept override final { PROFILER; return true; }
-        char const* buffer() const noexcept override final { return &cData; }
-        char const* extent() const noexcept override final { PROFILER; return &cData; }
-        char const* origin() const noexcept override final { return &cData; }
-        int depth() const noexcept override final { return 0; }
-
-        char const cData = '\0';
-    } const instance;
-
-    return Clone(instance);
-}
-
-String::data const* String::data::create(char const* p)
-{
-    assert(p);
+        if (pRoot) { enter(pRoot, false); return; }
 
-    auto n = strlen(p);
+        for (pByte = pEnd - 1; pByte > pBegin && (*pByte & 0xC0) == 0x80; --pByte);
+        return;
+    }
 
-    if (n > 0)
+    if (pByte)
     {
-        return new(n) StrBuf(p, n);
+        if (pByte > pBegin)
+        {
+            while (--pByte > pBegin && (*pByte & 0xC0) == 0x80);
+            return;
+        }
     }
-
-    PROFILER; return create();
-}
-
-String::data const* String::data::create(Char_t c, int n)
-{
-    assert(n >= 0);
-
-    if (c != '\0' && n > 0)
+    else if (nOffset > 0)
     {
-        return new StrRep(c, n);
+        --nOffset;
+        return;
     }
 
-    PROFILER; return create();
-}
-
-char const* String::data::evaluate(data const*& p)
-{
-    assert(p);
-
-    auto result = p->buffer();
-
-    if (!result)
+    for (; !path.empty(); path.pop_back())
     {
-        auto pData = new(p->size()) StrBuf(p);
-
-        Erase(p);
-        p = pData;
-        result = p->buffer();
+        auto& top = path.back();
+        if (top.second > 0) { enter(top.first->child(--top.second), false); return; }
     }
 
-    return result;
+    UNREACHABLE;
 }
 
 /***********************************************************************************************************************
-*** String
+*** String::Span
 ***********************************************************************************************************************/
 
-String::String() : pData(String::data::create())
+String::Span::Span() noexcept : pRoot(nullptr), pFill(nullptr), nFill(0)
 {
 }
 
-String::String(String const& r) : pData(Shared::Clone(r.pData))
+String::Span::Span(data const* p) : pRoot(Shared::Clone(p)), stack{ p }, pFill(nullptr), nFill(0)
 {
+    next();
 }
 
-String::String(String const& r, String const& s) : pData(r.pData->append(s.pData))
+String::Span::Span(char const* p, size_t n) noexcept : pRoot(nullptr), pFill(nullptr), nFill(0)
 {
+    memcpy(cChunk, p, n);
+    if (n) view = std::string_view(cChunk, n);
 }
 
-String::String(String const& r, int n) : pData(n > 0 ? r.pData->head(n) : String::data::create())
+String::Span::Span(Span const& r) : pRoot(Shared::Clone(r.pRoot)), stack(r.stack), pFill(r.pFill), nFill(r.nFill), view(r.view)
 {
+    if (view.data() == r.cChunk)
+    {
+        memcpy(cChunk, r.cChunk, view.size());
+        view = std::string_view(cChunk, view.size());
+    }
 }
 
-String::String(int n, String const& r) : pData(n > 0 ? r.pData->tail(n) : Shared::Clone(r.pData))
+String::Span::~Span()
 {
+    Shared::Erase(pRoot);
 }
 
-String::String(char const* p) : pData(p != 0 && *p != '\0' ? String::data::create(p) : String::data::create())
+String::Span& String::Span::operator=(Span const& r)
 {
+    Shared::Clone(r.pRoot);
+    Shared::Erase(pRoot);
+    pRoot = r.pRoot;
+    stack = r.stack;
+    pFill = r.pFill;
+    nFill = r.nFill;
+    view = r.view;
+
+    if (view.data() == r.cChunk)
+    {
+        memcpy(cChunk, r.cChunk, view.size());
+        view = std::string_view(cChunk, view.size());
+    }
+
+    return *this;
 }
 
-String::String(Char_t c, int n) : pData(c != 0 && n > 0 ? String::data::create(c, n) : String::data::create())
+void String::Span::next()
 {
+    if (pFill) { fill(); return; }
+
+    while (!stack.empty())
+    {
+        auto p = stack.back();
+
+        stack.pop_back();
+
+        if (auto k = p->count())
+        {
+            while (k--) stack.push_back(p->child(k));
+            continue;
+        }
+
+        if (!p->size()) { PROFILER; continue; }
+
+        if (auto q = p->span())
+        {
+            view = std::string_view(q, p->size());
+            return;
+        }
+
+        pFill = p;
+        nFill = 0;
+        fill();
+        return;
+    }
+
+    view = std::string_view();
 }
 
-String::~String()
+void String::Span::fill() noexcept
 {
-    Shared::Erase(pData);
+    assert(pFill && nFill < pFill->length());
+
+    size_t n = 0;
+
+    while (nFill < pFill->length() && n + 8 <= sizeof cChunk) n += UTF8_put(cChunk + n, pFill->at(nFill++));
+    if (nFill == pFill->length()) pFill = nullptr;
+
+    view = std::string_view(cChunk, n);
 }
 
-String& String::operator=(String const& r)
+/***********************************************************************************************************************
+*** String::Format
+***********************************************************************************************************************/
+
+String::Format::Format(String const& r)
 {
-    Shared::Clone(r.pData);
-    Shared::Erase(pData);
-    pData = r.pData;
-    return *this;
+    auto view = r.View();
+    auto p = view.data();
+    auto n = view.size();
+    std::string text;
+
+    auto flush = [this, &text]()
+    {
+        if (text.empty()) return;
+
+        String s(String::data::create(text.data(), text.size()));
+
+        s.Publish();
+        parts.push_back({ s, -1 });
+        text.clear();
+    };
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (p[i] == '}')
+        {
+            if (i + 1 == n || p[i + 1] != '}') throw "String::Format(): A '}' in the format is neither doubled nor closes a slot.";
+            text += p[++i];
+            continue;
+        }
+
+        if (p[i] != '{') { text += p[i]; continue; }
+        if (i + 1 < n && p[i + 1] == '{') { text += p[++i]; continue; }
+
+        int k = 0;
+        auto j = ++i;
+
+        for (; i < n && p[i] >= '0' && p[i] <= '9'; ++i)
+        {
+            if (k > (INT_MAX - 9) / 10) throw "String::Format(): The number of a slot is too large.";
+            k = 10 * k + (p[i] - '0');
+        }
+
+        if (i == j || i == n || p[i] != '}') throw "String::Format(): A slot must be a number in braces, such as {0}.";
+
+        flush();
+        parts.push_back({ String(), k });
+    }
+
+    flush();
 }
 
-String::operator char const* () const
+String String::Format::apply(String const* pArgs, size_t nArgs) const
 {
-    return String::data::evaluate(pData);
+    String const* local[16];
+    std::vector<String const*> more;
+    auto p = local;
+
+    if (parts.size() > sizeof local / sizeof *local) { more.resize(parts.size()); p = more.data(); }
+
+    size_t n = 0;
+
+    for (auto const& part : parts)
+    {
+        if (part.nSlot < 0) { p[n++] = &part.text; continue; }
+        if (size_t(part.nSlot) >= nArgs) throw "String::Format(): No argument was given for a slot of the format.";
+        p[n++] = pArgs + part.nSlot;
+    }
+
+    return from(String::data::concat(p, n));
 }
 
-void String::Get(char* p, size_t n) const
+/***********************************************************************************************************************
+*** String::Catalog
+***********************************************************************************************************************/
+
+String::Catalog::Catalog(String const& r)
 {
-    return pData->get(p, n);
+    auto view = r.View();
+    auto p = view.data();
+    auto pEnd = p + view.size();
+
+    auto trim = [](char const*& p, char const*& q)
+    {
+        while (p < q && (*p == ' ' || *p == '\t')) ++p;
+        while (q > p && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == '\r')) --q;
+    };
+
+    while (p < pEnd)
+    {
+        auto q = static_cast<char const*>(memchr(p, '\n', pEnd - p));
+        if (!q) q = pEnd;
+
+        auto pLine = p, pLineEnd = q;
+
+        p = q + (q < pEnd);
+        trim(pLine, pLineEnd);
+
+        if (pLine == pLineEnd || *pLine == '#') continue;
+
+        auto pEqual = static_cast<char const*>(memchr(pLine, '=', pLineEnd - pLine));
+        if (!pEqual) throw "String::Catalog(): A line has no '=' between the key and the format.";
+
+        auto pKey = pLine, pKeyEnd = pEqual;
+        auto pText = pEqual + 1, pTextEnd = pLineEnd;
+
+        trim(pKey, pKeyEnd);
+        trim(pText, pTextEnd);
+
+        if (pKey == pKeyEnd) throw "String::Catalog(): A line has no key before the '='.";
+
+        String key(std::string(pKey, pKeyEnd).c_str());
+        Format format(std::string(pText, pTextEnd).c_str());
+
+        key.Publish();
+        formats.insert_or_assign(key, std::move(format));
+    }
 }
 
-int String::Length() const
+String::Format const& String::Catalog::operator[](String const& key) const
 {
-    return pData->length();
+    auto p = Find(key);
+    if (!p) throw "String::Catalog::operator[](): The key is not in the catalog.";
+    return *p;
 }
 
-size_t String::Size() const
+String::Format const* String::Catalog::Find(String const& key) const
 {
-    return pData->size();
+    auto i = formats.find(key);
+    return i != formats.end() ? &i->second : nullptr;
 }
-
-/***********************************************************************************************************************
-*
-* TODO's:
-*
-*  - Literals
-*  - Translations
-*
-***********************************************************************************************************************/
@@ -25,6 +25,14 @@ SOFTWARE.
 
 #pragma once
 
+#include <functional>
+#include <iosfwd>
+#include <iterator>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 //**********************************************************************************************************************
 
 using Byte_t = char;
@@ -38,7 +46,11 @@ struct String final
 {
 	String();
 	String(String const&);
+	String(String&&) noexcept;
 	String(String const&, String const&);
+	String(String&&, String const&);  // These grow the node of an rvalue in place when nobody else holds it
+	String(String const&, String&&);
+	String(String&&, String&&);
 	String(String const&, int);
 	String(int, String const&);
 	String(char const*);
@@ -46,21 +58,301 @@ struct String final
 	~String();
 
 	String& operator=(String const&);
+	String& operator=(String&&) noexcept;
+	String& operator+=(String const&);
+
+	// NUL terminated bytes, flattened if need be.  The pointer stays valid only as long as this handle is neither assigned
+	// to, moved from nor destroyed: a string of up to INLINE_LIMIT bytes is kept inside the handle itself, and a longer
+	// one may be switched over to a flat copy that only this handle holds.  That switch is why several threads may call
+	// this at once on copies of a string, but on one and the same handle only once it has been published.
 
 	operator char const* () const;
 
+	// The bytes in one piece, not NUL terminated.  A single leaf, or a slice of one, is viewed where its bytes already
+	// are, and only a string whose bytes are spread over several pieces is flattened, as by operator char const*.
+
+	std::string_view View() const;
+	char const* Data() const { return View().data(); }
+
 	String Head(int n) const { return String(*this, n); }
 	String Tail(int n) const { return String(n, *this); }
 
 	void Get(char*, size_t) const;
+	bool WriteTo(int fd) const;  // Writes the bytes without flattening; returns false and leaves errno set on failure.
 	int Length() const;
 	size_t Size() const;
+	Char_t At(int) const;  // Code point at a position, or '\0' outside the string, looked up without flattening
+	int Depth() const;     // Of the tree of nodes, or 0 for a string kept in the handle, for tests and benchmarks
+	size_t Hash() const;  // Of the bytes only, cached per node, so after an edit only the new nodes are hashed
+
+	// Byte order, which for UTF-8 is also code point order.  The ropes are walked side by side without flattening, and
+	// a subtree that both strings share is skipped.  Equality returns early when the sizes or the known hashes differ.
+
+	int Compare(String const&) const;
+	int Compare(char const*) const;
+	bool Equals(String const&) const;
+	bool Equals(char const*) const;
+
+	// Code point position of the first match at or after nFrom, or of the last match, or -1.  The ropes are searched in
+	// place, including matches that straddle pieces, and the position works with Head() and Tail().
+
+	int Find(String const&, int nFrom = 0) const;
+	int RFind(String const&) const;
+	bool Contains(String const&) const;
+
+	// Call before several threads read this very object at once, rather than copies of it, which any thread may make,
+	// hold and destroy without it.
+
+	void Publish() const;
+
+	// Concatenated pieces of at most nLimit bytes in all are copied into one buffer instead of being linked, and pieces
+	// that are also referenced from elsewhere only up to nSharedLimit bytes.  The defaults are 128 and 32 bytes.
+
+	static void Coalesce(size_t nLimit, size_t nSharedLimit);
+
+	// Strings of up to nLimit bytes that are created from char const* are looked up in a table of weak references, and
+	// equal strings share one buffer for as long as any of them is alive.  Zero, the default, turns interning off.
+
+	static void Intern(size_t nLimit);
+
+	// A string whose node is also held by other strings keeps its flattened copy in the node, so that the others get it
+	// from operator char const* at no cost.  Copies that are attached to nodes hold at most nBudget bytes in all, 64 MB
+	// by default, and the least recently used ones are dropped from their nodes to stay within it, so that the nodes
+	// flatten again when next asked.  A lower budget drops copies at once, and zero drops them all.  The copy of a
+	// published node is the exception, and stays for as long as the node does.
+
+	static void Memoize(size_t nBudget);
+
+	// Maps a file, or a window of it, read-only into memory and returns its contents without copying them.  Slices and
+	// concatenations keep referring to the mapping, which is released with the last string that uses it.  A window may
+	// be at most 2 GB, and it is narrowed to the UTF-8 sequences that it holds whole.  Errors are thrown as string
+	// literals.
+
+	static String FromFile(char const* szPath, unsigned long long nOffset = 0, size_t nSize = size_t(-1));
+
+	// Reads a file descriptor, such as a pipe or a socket, or a stream to its end.  The input becomes leaves of 64 KiB
+	// in a balanced tree, without a final flatten, and a UTF-8 sequence is never split between two leaves.  Errors are
+	// thrown as string literals.
+
+	static String Read(int fd);
+	static String Read(std::istream&);
+
+	struct Arena;
+	struct Catalog;
+	struct Cursor;
+	struct Format;
+	struct Literal;
+	struct Span;
+
+	String(Literal const&);  // See operator""_s below
+
+	Cursor begin() const;
+	Cursor end() const;
+
+	Span Spans() const;
+	template <typename F> void Visit(F&& f) const;
 
 	struct data;
 
 private:
-	String(data const* p) : pData(p) { }
-	mutable data const* pData;
+	// Strings of up to INLINE_LIMIT bytes are kept inside the handle, NUL terminated, with the length and the size in the
+	// last byte.  Longer strings, and literals of any size, point to a node, and the last byte is HEAP.
+
+	static size_t const INLINE_LIMIT = 14;
+	static unsigned char const HEAP = 0xFF;
+
+	String(data const* p) noexcept { adopt(p); }
+
+	static String from(data const*);
+
+	struct Walk;
+
+	int search(String const&, bool) const;
+
+	unsigned char tag() const noexcept { return static_cast<unsigned char>(cInline[INLINE_LIMIT + 1]); }
+	bool isInline() const noexcept { return tag() != HEAP; }
+
+	void adopt(data const* p) noexcept { pData = p; cInline[INLINE_LIMIT + 1] = char(HEAP); }
+	void store(char const*, size_t, int) noexcept;
+	void extend(String const&, bool);
+	data const* node() const;  // New reference to a node with the same contents, created for an inline string
+
+	union
+	{
+		mutable data const* pData;
+		char cInline[INLINE_LIMIT + 2];
+	};
+};
+
+/***********************************************************************************************************************
+*** String::Cursor
+***********************************************************************************************************************/
+
+// Bidirectional iterator over the code points of a string.  The cursor keeps the path from the root to the current leaf
+// and a pointer to the current byte, so stepping is amortized O(1).  Cursors compare by position, and only cursors of
+// the same string are comparable.  A cursor holds on to the nodes of a long string, but for a short string it reads
+// the bytes inside the handle, which must then outlive the cursor as a container outlives its iterators.
+
+struct String::Cursor final
+{
+	using iterator_category = std::bidirectional_iterator_tag;
+	using value_type = Char_t;
+	using difference_type = std::ptrdiff_t;
+	using pointer = Char_t const*;
+	using reference = Char_t;
+
+	Cursor(Cursor const&);
+	~Cursor();
+
+	Cursor& operator=(Cursor const&);
+
+	Char_t operator*() const noexcept { return pByte && !(*pByte & 0x80) ? Char_t(*pByte) : get(); }
+
+	Cursor& operator++() noexcept { if (pByte && !(*pByte & 0x80) && pByte + 1 < pEnd) { ++pByte; ++nIndex; } else next(); return *this; }
+	Cursor& operator--() noexcept { if (pByte && pByte > pBegin && !(pByte[-1] & 0x80)) { --pByte; --nIndex; } else prev(); return *this; }
+	Cursor operator++(int) noexcept { Cursor r(*this); ++*this; return r; }
+	Cursor operator--(int) noexcept { Cursor r(*this); --*this; return r; }
+
+	bool operator==(Cursor const& r) const noexcept { return nIndex == r.nIndex; }
+	bool operator!=(Cursor const& r) const noexcept { return nIndex != r.nIndex; }
+
+	int Index() const noexcept { return nIndex; }
+
+private:
+	friend struct String;
+
+	Cursor(data const*, bool);
+	Cursor(char const*, size_t, int, bool) noexcept;  // Over the bytes of an inline string
+
+	Char_t get() const noexcept;
+	void next() noexcept;
+	void prev() noexcept;
+	void enter(data const*, bool);
+
+	data const* pRoot;                                // Or nullptr for an inline string
+	std::vector<std::pair<data const*, int>> path;  // Nodes above the current leaf, with the index of the child taken
+	data const* pLeaf;
+	char const* pBegin;
+	char const* pByte;                                // Current byte, or nullptr when the leaf has no bytes to point at
+	char const* pEnd;
+	int nOffset;                                      // Position within a leaf that has no bytes
+	int nIndex;
+};
+
+/***********************************************************************************************************************
+*** String::Span
+***********************************************************************************************************************/
+
+// Input iterator over the contiguous pieces of a string, left to right, without copying or flattening anything.  Slices
+// are trimmed to their own bytes, and a repeated character is produced in chunks from a buffer inside the iterator, so
+// a view stays valid only until the iterator is advanced.  Like std::filesystem::directory_iterator, a Span is a range
+// of itself: 'for (auto piece : s.Spans())'.
+
+struct String::Span final
+{
+	using iterator_category = std::input_iterator_tag;
+	using value_type = std::string_view;
+	using difference_type = std::ptrdiff_t;
+	using pointer = std::string_view const*;
+	using reference = std::string_view const&;
+
+	Span() noexcept;
+	Span(Span const&);
+	~Span();
+
+	Span& operator=(Span const&);
+
+	std::string_view const& operator*() const noexcept { return view; }
+	std::string_view const* operator->() const noexcept { return &view; }
+
+	Span& operator++() { next(); return *this; }
+	Span operator++(int) { Span r(*this); next(); return r; }
+
+	bool operator==(Span const& r) const noexcept { return view.data() == r.view.data(); }
+	bool operator!=(Span const& r) const noexcept { return view.data() != r.view.data(); }
+
+	Span begin() const { return *this; }
+	Span end() const { return Span(); }
+
+private:
+	friend struct String;
+
+	explicit Span(data const*);
+	Span(char const*, size_t) noexcept;
+
+	void next();
+	void fill() noexcept;
+
+	data const* pRoot;
+	std::vector<data const*> stack;  // Subtrees not visited yet, the next one on top
+	data const* pFill;               // Leaf without bytes of its own that is being produced in chunks
+	int nFill;
+	std::string_view view;
+	char cChunk[256];
+};
+
+template <typename F> void String::Visit(F&& f) const
+{
+	for (auto const& piece : Spans()) f(piece);
+}
+
+/***********************************************************************************************************************
+*** String::Literal
+***********************************************************************************************************************/
+
+// String literal with its size and length worked out by the compiler: "foo"_s.  A string made from it points straight
+// at the storage of the literal, through a leaf that is created once per literal and never counted or deleted, so that
+// a literal in a loop costs neither strlen() nor an allocation nor a copy.  The leaves are looked up by address, so only
+// operator""_s can make a Literal: storage that is reused or freed, such as a local array, must not reach them.
+
+struct String::Literal final
+{
+	char const* const pBytes;  // NUL terminated
+	size_t const nSize;
+	int const nLength;
+
+private:
+	friend constexpr Literal operator""_s(char const*, size_t) noexcept;
+
+	constexpr Literal(char const* p, size_t n) noexcept : pBytes(p), nSize(n), nLength(count(p, n)) { }
+
+	static constexpr int count(char const* p, size_t n) noexcept
+	{
+		int k = 0;
+		for (size_t i = 0; i < n; ++i) k += (p[i] & 0xC0) != 0x80;
+		return k;
+	}
+};
+
+constexpr String::Literal operator""_s(char const* p, size_t n) noexcept
+{
+	return String::Literal(p, n);
+}
+
+/***********************************************************************************************************************
+*** String::Arena
+***********************************************************************************************************************/
+
+// While an arena is alive, the buffers of the new strings that its thread builds are carved from large chunks owned by
+// the arena, and all of them are released at once when it goes out of scope.  Strings built inside the scope are meant
+// to be gone by then, but any that are still alive keep the chunks until the last of them goes away, on whichever
+// thread that happens.  Arenas nest, and the innermost one is used.
+
+struct String::Arena final
+{
+	Arena() noexcept;
+	~Arena();
+
+	Arena(Arena const&) = delete;
+	Arena& operator=(Arena const&) = delete;
+
+	struct Store;  // The chunks, counted by the buffers in them and by the arena itself
+
+private:
+	friend struct String::data;
+
+	Arena* pOuter;
+	Store* pStore;  // Created with the first chunk
 };
 
 //**********************************************************************************************************************
@@ -70,4 +362,99 @@ inline String operator+(String const& r, String const& s)
 	return String(r, s);
 }
 
+inline String operator+(String&& r, String const& s)
+{
+	return String(std::move(r), s);
+}
+
+inline String operator+(String const& r, String&& s)
+{
+	return String(r, std::move(s));
+}
+
+inline String operator+(String&& r, String&& s)
+{
+	return String(std::move(r), std::move(s));
+}
+
+inline bool operator==(String const& r, String const& s) { return r.Equals(s); }
+inline bool operator!=(String const& r, String const& s) { return !r.Equals(s); }
+inline bool operator<(String const& r, String const& s) { return r.Compare(s) < 0; }
+inline bool operator<=(String const& r, String const& s) { return r.Compare(s) <= 0; }
+inline bool operator>(String const& r, String const& s) { return r.Compare(s) > 0; }
+inline bool operator>=(String const& r, String const& s) { return r.Compare(s) >= 0; }
+
+inline bool operator==(String const& r, char const* p) { return r.Equals(p); }
+inline bool operator!=(String const& r, char const* p) { return !r.Equals(p); }
+inline bool operator<(String const& r, char const* p) { return r.Compare(p) < 0; }
+inline bool operator<=(String const& r, char const* p) { return r.Compare(p) <= 0; }
+inline bool operator>(String const& r, char const* p) { return r.Compare(p) > 0; }
+inline bool operator>=(String const& r, char const* p) { return r.Compare(p) >= 0; }
+
+inline bool operator==(char const* p, String const& r) { return r.Equals(p); }
+inline bool operator!=(char const* p, String const& r) { return !r.Equals(p); }
+inline bool operator<(char const* p, String const& r) { return r.Compare(p) > 0; }
+inline bool operator<=(char const* p, String const& r) { return r.Compare(p) >= 0; }
+inline bool operator>(char const* p, String const& r) { return r.Compare(p) < 0; }
+inline bool operator>=(char const* p, String const& r) { return r.Compare(p) <= 0; }
+
+namespace std
+{
+	template <> struct hash<String>
+	{
+		size_t operator()(String const& r) const { return r.Hash(); }
+	};
+}
+
+/***********************************************************************************************************************
+*** String::Format
+***********************************************************************************************************************/
+
+// Message template such as "Copied {1} files to {0}", parsed once and then applied to any number of argument lists.
+// Slots are numbered from zero, in any order and as often as needed, and "{{" and "}}" stand for single braces.  The
+// result links the text of the template and the arguments together without copying them, unless it is so short that
+// a copy is cheaper (see Coalesce()).  Malformed templates and missing arguments are thrown as string literals.
+
+struct String::Format final
+{
+	explicit Format(String const&);
+
+	template <typename... T> String operator()(T const&... args) const
+	{
+		String const v[] = { String(args)..., String() };
+		return apply(v, sizeof...(T));
+	}
+
+private:
+	String apply(String const*, size_t) const;
+
+	struct Part
+	{
+		String text;  // Always held by a node, published, so that applying the format only adds references
+		int nSlot;    // Argument that goes here instead, or -1 for text
+	};
+
+	std::vector<Part> parts;
+};
+
+/***********************************************************************************************************************
+*** String::Catalog
+***********************************************************************************************************************/
+
+// Formats by key, such as the messages of one language, parsed from lines of 'key = format', for example out of
+// String::FromFile().  White space around the key and the format is ignored, and so are empty lines and lines that
+// start with '#'.  A key that occurs twice keeps its last format.  Errors are thrown as string literals.
+
+struct String::Catalog final
+{
+	explicit Catalog(String const&);
+
+	Format const& operator[](String const&) const;  // Throws if the key is not in the catalog
+	Format const* Find(String const&) const;        // Or nullptr
+	size_t Size() const noexcept { return formats.size(); }
+
+private:
+	std::unordered_map<String, Format> formats;
+};
+
 //**********************************************************************************************************************
@@ -26,13 +26,20 @@ SOFTWARE.
 #pragma once
 
 #include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 //**********************************************************************************************************************
 
 #define FAIL(why) do { std::cerr << std::endl << "Function '" __FUNCTION__ "(...)' failed: " why "." << std::endl; abort(); } while(false)
-#define PROFILER do { static auto f=__FUNCTION__; static auto l=__LINE__; static struct S { int n{}; ~S() { std::cerr << "PROFILER: Function \"" << f << "(...)\" line " << l << " was invoked " << n << " times." << std::endl; } } s; ++s.n; } while (false)
+#define PROFILER do { static auto f=__FUNCTION__; static auto l=__LINE__; static struct S { std::atomic<int> n{}; ~S() { std::cerr << "PROFILER: Function \"" << f << "(...)\" line " << l << " was invoked " << n << " times." << std::endl; } } s; s.n.fetch_add(1, std::memory_order_relaxed); } while (false)
 #define TODO do { throw "TODO: Function '" __FUNCTION__ "(...)'."; } while(false)
 #define UNREACHABLE do { std::cerr << std::endl << "Executing code that was thought to be unreachable at '" __FUNCTION__ "(...)' line " << __LINE__ << "." << std::endl; abort(); } while(false)
 #if !defined(_DEBUG)
@@ -45,36 +52,349 @@ SOFTWARE.
 *** Shared
 ***********************************************************************************************************************/
 
+// Reference counts are biased towards the thread that creates an object.  That thread counts its references without
+// atomic read-modify-write operations, and every other thread counts in a second, atomic counter, which goes below zero
+// when references that the creating thread took are let go elsewhere.  The creating thread merges the two counters when
+// its own count runs out, and the object is counted atomically from then on.  An object whose atomic counter goes below
+// zero first is queued for the creating thread to merge, which happens when that thread next runs out of references
+// to an object of its own, every POLL_PERIOD of its releases in any case, and when it exits.  If it has already exited,
+// the thread that found the object merges it.  Objects can therefore be copied and moved between threads without any
+// preparation.  The counters, the flags and the creating thread fit in 16 bytes next to the virtual table pointer.
+
 struct Shared
 {
-	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T const* Clone(T const* p) noexcept { if (p) ++p->nShared; return p; }
-	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T const* Clone(T const& r) noexcept { ++r.nShared; return &r; }
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T const* Clone(T const* p) noexcept { if (p) p->Acquire(); return p; }
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T const* Clone(T const& r) noexcept { r.Acquire(); return &r; }
 #if defined(ENABLE_NONCONST_SHARED)
-	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T* Clone(T* p) noexcept { if (p) ++p->nShared; return p; }
-	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T* Clone(T& r) noexcept { ++r.nShared; return &r; }
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T* Clone(T* p) noexcept { if (p) p->Acquire(); return p; }
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T* Clone(T& r) noexcept { r.Acquire(); return &r; }
 #endif
-	static inline void Erase(Shared const* p) noexcept { if (p && !--p->nShared) delete p; }
+	static inline void Erase(Shared const* p) noexcept { if (p && p->Release()) delete p; }
+
+	// Like Clone, but returns nullptr rather than revive an object whose last reference is being released, for example
+	// by another thread while the object is still listed in a table of weak references.
+
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Shared, T>::value>::type> static inline T const* TryClone(T const* p) noexcept { return p && p->TryAcquire() ? p : nullptr; }
+
+	// Marks an object, and everything it owns, as read by several threads at once through one and the same handle, so
+	// that what the handle works out lazily has to be kept in the object rather than replace it.  Handing copies of the
+	// handle over to other threads does not need it.
+
+	static inline void Publish(Shared const* p) noexcept { if (p && !p->IsPublished()) { p->nShared.fetch_or(PUBLISHED, std::memory_order_relaxed); p->published(); } }
 
 protected:
-	Shared() noexcept : nShared(1) { }
-	Shared(Shared const&) noexcept : nShared(1) { }
+	// An immortal object lives until the program ends.  It is published from the start, and Clone() and Erase() leave
+	// its reference count alone, so it can be handed out from any thread without touching a shared cache line.
+
+	struct Immortal { };
+
+	Shared() noexcept;
+	Shared(Shared const&) noexcept;
+	explicit Shared(Immortal) noexcept : nOwner(IMMORTAL), nBiased(0), nShared(ONE | MERGED | PUBLISHED) { }
 	virtual ~Shared() noexcept = 0;
 
-	bool IsShared() const noexcept { return nShared > 1; }
+	// Whether there are references besides the caller's own.  A thread other than the creating one cannot see the count
+	// of the creating thread, so it gets true until the counters have been merged.
+
+	bool IsShared() const noexcept
+	{
+		if (IsImmortal()) return true;
+
+		auto n = nShared.load(std::memory_order_acquire);
+
+		if (IsOwner()) return nBiased + count(n) > 1;
+		return !(n & MERGED) || count(n) > 1;
+	}
+
+	bool IsPublished() const noexcept { return nShared.load(std::memory_order_relaxed) & PUBLISHED; }
+
+	virtual void published() const noexcept { }
 
 private:
-	mutable size_t nShared;
+	struct Owner;
+
+	static ptrdiff_t const MERGED = 1;     // The creating thread has handed its count over
+	static ptrdiff_t const QUEUED = 2;     // Waiting for the creating thread to hand its count over
+	static ptrdiff_t const PUBLISHED = 4;  // See Publish()
+	static ptrdiff_t const ONE = 8;        // One reference in the atomic counter, above the flags
+
+	static uint32_t const IMMORTAL = ~uint32_t(0);  // In place of a creating thread, which never gets this number
+	static unsigned const POLL_PERIOD = 256;
+
+	static ptrdiff_t count(ptrdiff_t n) noexcept { return (n - (n & (ONE - 1))) / ONE; }
+	static bool last(ptrdiff_t n) noexcept { return (n & ~PUBLISHED) == MERGED; }  // No references left, nor any to come
+
+	explicit Shared(uint32_t n) noexcept : nOwner(n), nBiased(n ? 1 : 0), nShared(n ? 0 : ONE | MERGED) { }
+
+	bool IsOwner() const noexcept;
+	bool IsImmortal() const noexcept { return nOwner.load(std::memory_order_relaxed) == IMMORTAL; }
+
+	void Acquire() const noexcept
+	{
+		if (IsOwner()) ++nBiased;
+		else if (IsImmortal()) return;
+		else nShared.fetch_add(ONE, std::memory_order_relaxed);
+	}
+
+	bool TryAcquire() const noexcept
+	{
+		if (IsOwner()) { ++nBiased; return true; }
+		if (IsImmortal()) return true;
+
+		auto n = nShared.load(std::memory_order_relaxed);
+
+		do
+		{
+			if (last(n)) return false;
+		} while (!nShared.compare_exchange_weak(n, n + ONE, std::memory_order_relaxed));
+
+		return true;
+	}
+
+	// Whoever leaves the atomic counter at zero, merged and not queued deletes the object, and the reference counts
+	// cannot change after that.
+
+	bool Release() const noexcept;
+	bool Enqueue() const noexcept;
+	bool Merge() const noexcept;
+
+	mutable std::atomic<ptrdiff_t> nShared;  // References counted by the other threads, and the flags
+	mutable std::atomic<uint32_t> nOwner;    // Creating thread, 0 once the counters have been merged, or IMMORTAL
+	mutable int32_t nBiased;                 // References counted by the creating thread
 
 	Shared(Shared&&) = delete;
 	Shared& operator=(Shared&&) = delete;
 	Shared& operator=(Shared const&) = delete;
 };
 
+// The threads that have created objects, by numbers that are never reused, and the objects queued for each of them.
+// The thread local part is trivially destructible, like the caches of FixedPool, and the registry is never destroyed,
+// since objects may be released after the thread local destructors, and static destruction, have run.
+
+struct Shared::Owner final
+{
+	struct Queue;
+
+	struct Local
+	{
+		uint32_t nId;      // Or 0 before the first object, and again from when the thread starts to exit
+		unsigned nTick;    // Releases of objects of its own, counted to POLL_PERIOD
+		Queue* pQueue;
+		bool bGone;        // The thread has exited, or could not be registered, and its objects are counted atomically
+	};
+
+	static Local& local() noexcept { thread_local Local local{ 0, 0, nullptr, false }; return local; }
+
+	static uint32_t enter() noexcept
+	{
+		auto& r = local();
+		if (!r.nId && !r.bGone) join(r);
+		return r.nId;
+	}
+
+	static void poll() noexcept
+	{
+		auto q = local().pQueue;
+		if (q && q->bPending.load(std::memory_order_relaxed)) drain(q);
+	}
+
+	// Polls now and then even while the thread holds on to all of its objects, so that the ones queued to it are freed.
+
+	static void tick() noexcept
+	{
+		auto& r = local();
+		if (++r.nTick == POLL_PERIOD) { r.nTick = 0; poll(); }
+	}
+
+	static bool hand(Shared const*) noexcept;  // Returns whether the caller deletes the object
+
+	struct Queue
+	{
+		std::atomic<bool> bPending{ false };
+		std::vector<Shared const*> items;
+	};
+
+private:
+	struct Registry
+	{
+		std::mutex mutex;
+		uint32_t nLast = 0;
+		std::unordered_map<uint32_t, Queue*> queues;
+	};
+
+	struct Leave
+	{
+		~Leave();
+	};
+
+	static Registry& registry() { static Registry* p = new Registry; return *p; }
+
+	static void join(Local&) noexcept;
+	static void drain(Queue*) noexcept;
+};
+
+inline Shared::Shared() noexcept : Shared(Owner::enter())
+{
+}
+
+inline Shared::Shared(Shared const&) noexcept : Shared(Owner::enter())
+{
+}
+
 inline Shared::~Shared()
 {
 	assert(!IsShared());
 }
 
+inline bool Shared::IsOwner() const noexcept
+{
+	auto n = nOwner.load(std::memory_order_relaxed);
+	return n && n == Owner::local().nId;
+}
+
+inline bool Shared::Release() const noexcept
+{
+	if (IsOwner())
+	{
+		if (--nBiased) { Owner::tick(); return false; }
+
+		nOwner.store(0, std::memory_order_relaxed);
+
+		auto n = nShared.fetch_or(MERGED, std::memory_order_acq_rel) | MERGED;
+
+		Owner::poll();
+		return last(n);
+	}
+
+	if (IsImmortal()) return false;
+
+	auto n = nShared.fetch_sub(ONE, std::memory_order_release) - ONE;
+
+	if (last(n))
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return true;
+	}
+
+	return n < 0 && !(n & QUEUED) && Enqueue();
+}
+
+inline bool Shared::Enqueue() const noexcept
+{
+	auto n = nShared.load(std::memory_order_relaxed);
+
+	do
+	{
+		if (n >= 0 || (n & QUEUED)) return false;
+	} while (!nShared.compare_exchange_weak(n, n | QUEUED, std::memory_order_relaxed));
+
+	return Owner::hand(this);
+}
+
+// Adds the count of the creating thread, unless that thread has done so itself, to the atomic counter, and takes the
+// object off the queue.  Only the creating thread, or any thread after it has exited, may do this.
+
+inline bool Shared::Merge() const noexcept
+{
+	auto nAdd = nOwner.load(std::memory_order_relaxed) ? nBiased * ONE + MERGED - QUEUED : -QUEUED;
+
+	nOwner.store(0, std::memory_order_relaxed);
+	nBiased = 0;
+
+	return last(nShared.fetch_add(nAdd, std::memory_order_acq_rel) + nAdd);
+}
+
+inline void Shared::Owner::join(Local& r) noexcept
+{
+	try
+	{
+		thread_local Leave leave;
+		(void)leave;
+
+		auto q = new Queue;
+		auto& g = registry();
+		std::lock_guard<std::mutex> lock(g.mutex);
+
+		try
+		{
+			g.queues.emplace(g.nLast + 1, q);
+		}
+		catch (...)
+		{
+			delete q;
+			throw;
+		}
+
+		r.nId = ++g.nLast;
+		r.pQueue = q;
+	}
+	catch (...)
+	{
+		r.bGone = true;
+	}
+}
+
+inline Shared::Owner::Leave::~Leave()
+{
+	auto& r = local();
+	auto q = r.pQueue;
+
+	if (!q) return;
+
+	std::vector<Shared const*> items;
+	{
+		auto& g = registry();
+		std::lock_guard<std::mutex> lock(g.mutex);
+
+		g.queues.erase(r.nId);
+		items.swap(q->items);
+		r = Local{ 0, 0, nullptr, true };
+	}
+
+	delete q;
+	for (auto p : items) if (p->Merge()) delete p;
+}
+
+inline void Shared::Owner::drain(Queue* q) noexcept
+{
+	std::vector<Shared const*> items;
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+
+		items.swap(q->items);
+		q->bPending.store(false, std::memory_order_relaxed);
+	}
+
+	for (auto p : items) if (p->Merge()) delete p;
+}
+
+// An object that cannot be queued for want of memory is leaked, because its creating thread may still be counting it.
+
+inline bool Shared::Owner::hand(Shared const* p) noexcept
+{
+	{
+		auto& g = registry();
+		std::lock_guard<std::mutex> lock(g.mutex);
+		auto it = g.queues.find(p->nOwner.load(std::memory_order_relaxed));
+
+		if (it != g.queues.end())
+		{
+			try
+			{
+				it->second->items.push_back(p);
+				it->second->bPending.store(true, std::memory_order_relaxed);
+			}
+			catch (...)
+			{
+			}
+
+			return false;
+		}
+	}
+
+	return p->Merge();
+}
+
 /***********************************************************************************************************************
 *** Saved
 ***********************************************************************************************************************/
@@ -97,6 +417,172 @@ private:
 	T& reference;
 };
 
+/***********************************************************************************************************************
+*** FixedPool
+***********************************************************************************************************************/
+
+// Allocator for blocks of N bytes.  Each thread takes blocks from a free list of its own, without locking, and refills
+// it a batch at a time from a shared depot that carves cache line aligned slabs.  Blocks freed by another thread join
+// the free list of that thread, and a list that grows too long, or belongs to a thread that exits, is handed back to
+// the depot.  Slabs are never returned to the system.
+
+#if defined(COUNT_ALLOCATIONS)
+void CountAllocation(size_t) noexcept;  // Defined by the program, called with N for each block taken from a FixedPool
+#endif
+
+template <size_t N> struct FixedPool final
+{
+	static_assert(N >= sizeof(void*) && N % alignof(std::max_align_t) == 0, "FixedPool<N> needs N to be a multiple of the maximum alignment");
+
+	static void* allocate()
+	{
+		auto& cache = local();
+		auto p = cache.pFree ? cache.pFree : refill(cache);
+
+		cache.pFree = p->pNext;
+		--cache.nFree;
+#if defined(COUNT_ALLOCATIONS)
+		CountAllocation(N);
+#endif
+		return p;
+	}
+
+	static void deallocate(void* p) noexcept
+	{
+		assert(p);
+
+		auto& cache = local();
+		auto q = static_cast<Slot*>(p);
+
+		q->pNext = cache.pFree;
+		cache.pFree = q;
+
+		if (++cache.nFree > LIMIT || cache.bDetached) release(cache);
+	}
+
+private:
+	struct Slot { Slot* pNext; };
+
+	struct Cache
+	{
+		Slot* pFree;
+		size_t nFree;
+		bool bDetached;  // The thread is exiting, and its cache no longer holds on to anything
+	};
+
+	struct Depot
+	{
+		std::mutex mutex;
+		Slot* pFree = nullptr;
+		std::vector<void*> slabs;
+	};
+
+	struct Detach
+	{
+		~Detach() { auto& cache = local(); cache.bDetached = true; release(cache); }
+	};
+
+	static size_t const SLAB_SIZE = N <= 2048 ? 16384 : 4 * N;
+	static size_t const BATCH = SLAB_SIZE / N;
+	static size_t const LIMIT = 4 * BATCH;
+	static size_t const CACHE_LINE = 64;
+
+	// The thread local cache is trivially destructible, so that it can still be used by objects that are deleted after
+	// the thread local destructors have run.  The depot is deliberately never destroyed for the same reason.
+
+	static Cache& local() noexcept { thread_local Cache cache{ nullptr, 0, false }; return cache; }
+	static Depot& depot() { static Depot* p = new Depot; return *p; }
+
+	static Slot* refill(Cache& cache)
+	{
+		if (!cache.bDetached) { thread_local Detach detach; (void)detach; }
+
+		auto& d = depot();
+		std::lock_guard<std::mutex> lock(d.mutex);
+
+		if (!d.pFree)
+		{
+			PROFILER;
+			d.slabs.reserve(d.slabs.size() + 1);  // So that a new slab is never lost to a failing push_back()
+			auto p = static_cast<char*>(::operator new(SLAB_SIZE, std::align_val_t(CACHE_LINE)));
+
+			d.slabs.push_back(p);
+			for (auto i = BATCH; i--; )
+			{
+				auto q = reinterpret_cast<Slot*>(p + i * N);
+
+				q->pNext = d.pFree;
+				d.pFree = q;
+			}
+		}
+
+		auto n = cache.bDetached ? 1 : BATCH;
+		auto p = d.pFree;
+
+		for (cache.pFree = p; --n && p->pNext; ++cache.nFree) p = p->pNext;
+
+		++cache.nFree;
+		d.pFree = p->pNext;
+		p->pNext = nullptr;
+		return cache.pFree;
+	}
+
+	// Keeps the first half of the local free list, or nothing after the thread has detached, and hands the rest over
+	// to the depot.
+
+	static void release(Cache& cache) noexcept
+	{
+		auto n = cache.bDetached ? 0 : LIMIT / 2;
+		auto pFirst = cache.pFree;
+		Slot* pLast = nullptr;
+
+		for (size_t i = 0; i < n && pFirst; ++i) { pLast = pFirst; pFirst = pFirst->pNext; }
+		if (!pFirst) return;
+
+		if (pLast) pLast->pNext = nullptr; else cache.pFree = nullptr;
+		cache.nFree = n;
+
+		auto p = pFirst;
+		while (p->pNext) p = p->pNext;
+
+		auto& d = depot();
+		std::lock_guard<std::mutex> lock(d.mutex);
+
+		p->pNext = d.pFree;
+		d.pFree = pFirst;
+	}
+};
+
+/***********************************************************************************************************************
+*** Pooled
+***********************************************************************************************************************/
+
+// Class level allocator for small objects of one fixed size: 'struct T final : public Pooled<T>'.  Objects of the same
+// size, rounded up to the maximum alignment, share one FixedPool.  T is still incomplete when Pooled<T> is
+// instantiated, so the size is only looked at inside the functions.
+
+template <typename T> struct Pooled
+{
+	static void* operator new(size_t n)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Pooled<T> does not support over-aligned types");
+		static_assert(sizeof(T) <= 2048, "Pooled<T> is meant for small objects");
+
+		if (n != sizeof(T)) { PROFILER; return ::operator new(n); }
+		return FixedPool<slot()>::allocate();
+	}
+
+	static void operator delete(void* p, size_t n) noexcept
+	{
+		if (!p) return;
+		if (n != sizeof(T)) { PROFILER; ::operator delete(p); return; }
+		FixedPool<slot()>::deallocate(p);
+	}
+
+private:
+	static constexpr size_t slot() noexcept { return (sizeof(T) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t); }
+};
+
 /***********************************************************************************************************************
 *** Objectguard
 ***********************************************************************************************************************/
@@ -116,19 +602,24 @@ namespace
 		size_t nSerialNumber;
 
 		static size_t nCreationCount;
+		static std::mutex& mutex() { static std::mutex m; return m; }
 
 		Guarded() noexcept : pNext(this), pPrev(this), nSerialNumber(++nCreationCount)
 		{
 		}
 
-		Guarded(Guarded const& r) noexcept : nSerialNumber(++nCreationCount), pNext(&r), pPrev(pNext->pPrev)
+		Guarded(Guarded const& r) noexcept : pNext(&r), pPrev(nullptr), nSerialNumber(0)
 		{
+			std::lock_guard<std::mutex> lock(mutex());
+			nSerialNumber = ++nCreationCount;
+			pPrev = pNext->pPrev;
 			pNext->pPrev = this;
 			pPrev->pNext = this;
 		}
 
 		virtual ~Guarded() noexcept
 		{
+			std::lock_guard<std::mutex> lock(mutex());
 			pNext->pPrev = pPrev;
 			pPrev->pNext = pNext;
 		}
@@ -195,11 +686,11 @@ template <typename T> struct ObjectGuard : public Guarded
 
 	} &instance() { static data d; return d; };
 
-	ObjectGuard() : Guarded(instance().root) { ++instance(); }
-	ObjectGuard(ObjectGuard const&) : Guarded(instance().root) { ++instance(); }
+	ObjectGuard() : Guarded(instance().root) { std::lock_guard<std::mutex> lock(mutex()); ++instance(); }
+	ObjectGuard(ObjectGuard const&) : Guarded(instance().root) { std::lock_guard<std::mutex> lock(mutex()); ++instance(); }
 
 protected:
-	~ObjectGuard() { --instance(); }
+	~ObjectGuard() { std::lock_guard<std::mutex> lock(mutex()); --instance(); }
 };
 
 #endif
@@ -0,0 +1,50 @@
+#include "Bench.h"
+
+#include <stdlib.h>
+#include <new>
+
+//**********************************************************************************************************************
+
+// Counts the blocks that this thread takes from the heap and from the pools.  The replaced operator new and delete
+// stand in for the plain and the aligned forms, which the array, sized and nothrow forms forward to.
+
+namespace
+{
+	thread_local Allocations counted{ 0, 0 };
+
+	void* allocate(size_t n, size_t nAlign)
+	{
+		n = n ? n : 1;
+		++counted.nCount;
+		counted.nBytes += n;
+
+#if defined(_WIN32)
+		auto p = nAlign ? _aligned_malloc(n, nAlign) : malloc(n);
+#else
+		auto p = nAlign ? aligned_alloc(nAlign, (n + nAlign - 1) / nAlign * nAlign) : malloc(n);
+#endif
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+}
+
+void CountAllocation(size_t n) noexcept
+{
+	++counted.nCount;
+	counted.nBytes += n;
+}
+
+Allocations Allocated() noexcept
+{
+	return counted;
+}
+
+void* operator new(size_t n) { return allocate(n, 0); }
+void* operator new(size_t n, std::align_val_t a) { return allocate(n, size_t(a)); }
+void operator delete(void* p) noexcept { free(p); }
+
+#if defined(_WIN32)
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+#endif
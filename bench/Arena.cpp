@@ -0,0 +1,51 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Creates and destroys 1000 leaves of 200 bytes, from the size classes and from an arena, and flattens ropes of 1000
+// pieces, which allocates one leaf of 200 KB.  Each is timed and counted.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		std::string line;
+		while (line.size() < 200) line += "kissa ";
+		line.resize(200);
+
+		both("Create and destroy 1000 leaves of 200 bytes", 1000, [&line]()
+		{
+			std::vector<String> v;
+			v.reserve(1000);
+			for (int i = 0; i < 1000; ++i) v.emplace_back(line.c_str());
+			Keep(v.data());
+		});
+
+		both("Create and destroy 1000 leaves of 200 bytes in an arena", 1000, [&line]()
+		{
+			String::Arena arena;
+			std::vector<String> v;
+			v.reserve(1000);
+			for (int i = 0; i < 1000; ++i) v.emplace_back(line.c_str());
+			Keep(v.data());
+		});
+
+		String rope;
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 1000; ++i) rope += String(line.c_str());
+		String::Coalesce(128, 32);
+
+		both("Flatten a copy of 1000 leaves of 200 bytes", 1000, [&rope]() { String s = rope + "!"_s; Keep(static_cast<char const*>(s)); });
+	}
+
+	Benchmark arena("arena", run);
+}
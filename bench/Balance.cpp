@@ -0,0 +1,59 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Builds ropes of up to 100000 pieces by appending, by prepending and by alternating between the two, with coalescing
+// turned off so that every piece stays a leaf, and prints the depth of the tree and the time of looking up a code point
+// as the rope grows.  Both should grow with the logarithm of the number of pieces whatever the order.
+
+namespace
+{
+	enum Order { APPEND, PREPEND, ALTERNATE };
+
+	void grow(char const* szWhat, Order order)
+	{
+		String s;
+		int nPieces = 0;
+
+		String::Coalesce(0, 0);
+
+		for (int nStop = 1000; nStop <= 100000; nStop *= 10)
+		{
+			auto nFirst = nPieces;
+			auto t = std::chrono::steady_clock::now();
+
+			for (; nPieces < nStop; ++nPieces)
+			{
+				String piece('a' + nPieces % 26, 20);
+				auto bFront = order == PREPEND || (order == ALTERNATE && nPieces % 2);
+
+				s = bFront ? std::move(piece) + std::move(s) : std::move(s) + std::move(piece);
+			}
+
+			std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - t;
+			auto r = 12345u;
+
+			auto tAt = Time(1000000, [&s, &r]()
+			{
+				r = r * 1103515245 + 12345;
+				auto c = s.At(int(r >> 8) % s.Length());
+				Keep(&c);
+			});
+
+			std::cout << szWhat << " " << nStop << " pieces: depth " << s.Depth() << ", " << d.count() / (nStop - nFirst) << " ns a piece, At() " << tAt << " ns" << std::endl;
+		}
+
+		String::Coalesce(128, 32);
+	}
+
+	void run()
+	{
+		grow("Append", APPEND);
+		grow("Prepend", PREPEND);
+		grow("Alternate", ALTERNATE);
+	}
+
+	Benchmark balance("balance", run);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../Tekstaus.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+//**********************************************************************************************************************
+
+// A benchmark prints one line for each thing that it measures, so that the output of two builds can be compared line by
+// line.  Each source file registers its benchmarks under a name with a static Benchmark object, and the name given on
+// the command line picks them, or all of them when there is none.
+
+struct Benchmark final
+{
+	Benchmark(char const* szName, void (*pRun)()) : szName(szName), pRun(pRun) { all().push_back(this); }
+
+	static std::vector<Benchmark const*>& all() { static std::vector<Benchmark const*> v; return v; }
+
+	char const* const szName;
+	void (*const pRun)();
+};
+
+// Keeps the compiler from leaving out work whose result is not otherwise used.  It is defined in another translation
+// unit for that reason.
+
+void Keep(void const*) noexcept;
+
+// Mean time of a round of f in ns, over n rounds that follow one round that is not timed.
+
+template <typename F> double Time(size_t n, F&& f)
+{
+	f();
+
+	auto t = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; ++i) f();
+	std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - t;
+
+	return d.count() / n;
+}
+
+// Times n rounds of f, and prints the mean time of a round.
+
+template <typename F> void Measure(char const* szWhat, size_t n, F&& f)
+{
+	std::cout << szWhat << ": " << Time(n, f) << " ns" << std::endl;
+}
+
+// Blocks and bytes that this thread has taken from the heap and from the pools so far.  The pools are only counted in
+// a build with COUNT_ALLOCATIONS defined, as the benchmarks are built.
+
+struct Allocations
+{
+	size_t nCount;
+	size_t nBytes;
+};
+
+Allocations Allocated() noexcept;
+
+// Runs n rounds of f, which are not timed, and prints the mean number of blocks and bytes that a round allocates.
+
+template <typename F> void Count(char const* szWhat, size_t n, F&& f)
+{
+	f();
+
+	auto a = Allocated();
+	for (size_t i = 0; i < n; ++i) f();
+	auto b = Allocated();
+
+	std::cout << szWhat << ": " << double(b.nCount - a.nCount) / n << " allocations, " << double(b.nBytes - a.nBytes) / n << " bytes" << std::endl;
+}
+
+// Runs body(nThread, nRounds) on n threads that start together, and prints the wall clock time of one round, which
+// stays the same as threads are added as long as they do not get in each other's way.
+
+template <typename F> void Parallel(char const* szWhat, unsigned n, size_t nRounds, F const& body)
+{
+	std::vector<std::thread> threads;
+	std::atomic<unsigned> nReady{ 0 };
+	std::atomic<bool> bGo{ false };
+
+	for (unsigned i = 0; i < n; ++i) threads.emplace_back([&, i]()
+	{
+		++nReady;
+		while (!bGo.load()) std::this_thread::yield();
+		body(i, nRounds);
+	});
+
+	while (nReady.load() < n) std::this_thread::yield();
+
+	auto t = std::chrono::steady_clock::now();
+	bGo.store(true);
+	for (auto& thread : threads) thread.join();
+	std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - t;
+
+	std::cout << szWhat << ", " << n << " threads: " << d.count() / nRounds << " ns" << std::endl;
+}
@@ -0,0 +1,74 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Builds strings by appending pieces one at a time, as programs do, with coalescing at its defaults, off, and at a higher
+// limit: 100000 words of 3 to 12 bytes, 1000 chunks of 4 KB, and words with a chunk of 1 KB after every hundredth.
+// Building is timed and counted, and the results are then sliced in the middle and flattened.
+
+namespace
+{
+	struct Policy
+	{
+		char const* szName;
+		size_t nLimit;
+		size_t nSharedLimit;
+	};
+
+	Policy const policies[] = { { "default coalescing", 128, 32 }, { "no coalescing", 0, 0 }, { "coalescing up to 1 KB", 1024, 32 } };
+
+	std::string const chunk(4096, 'k');
+
+	String words(size_t n, size_t nChunk)
+	{
+		char const cWord[] = "abcdefghijkl";
+		String s;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			s += String(std::string(cWord, 3 + i % 10).c_str());
+			if (nChunk && i % 100 == 99) s += String(chunk.substr(0, nChunk).c_str());
+		}
+
+		return s;
+	}
+
+	String chunks(size_t n)
+	{
+		String s;
+		for (size_t i = 0; i < n; ++i) s += String(chunk.c_str());
+		return s;
+	}
+
+	template <typename F> void build(char const* szWhat, size_t n, F const& f)
+	{
+		for (auto& policy : policies)
+		{
+			auto const name = std::string(szWhat) + ", " + policy.szName;
+
+			String::Coalesce(policy.nLimit, policy.nSharedLimit);
+
+			Measure(name.c_str(), n, [&f]() { auto s = f(); Keep(&s); });
+			Count(name.c_str(), n, [&f]() { auto s = f(); Keep(&s); });
+
+			auto const s = f();
+			auto const middle = int(s.Length() / 2);
+
+			Measure((name + ", slice the middle").c_str(), 100000, [&s, middle]() { auto r = s.Tail(middle).Head(10); Keep(&r); });
+			Measure((name + ", flatten").c_str(), 20, [&s]() { String r = s + "!"_s; Keep(static_cast<char const*>(r)); });
+		}
+
+		String::Coalesce(128, 32);
+	}
+
+	void run()
+	{
+		build("Append 100000 words", 10, []() { return words(100000, 0); });
+		build("Append 1000 chunks of 4 KB", 10, []() { return chunks(1000); });
+		build("Append 100000 words and 1000 chunks of 1 KB", 10, []() { return words(100000, 1024); });
+	}
+
+	Benchmark coalesce("coalesce", run);
+}
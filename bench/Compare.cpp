@@ -0,0 +1,46 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Compares ropes of 20000 short pieces in place, next to flattening copies of them and comparing those, which is what
+// callers did before, and to comparing the same bytes as std::string.  Comparing in place should allocate nothing.
+
+namespace
+{
+	String rope(size_t nPieces, size_t nPiece)
+	{
+		String s;
+
+		String::Coalesce(0, 0);
+		for (size_t i = 0; i < nPieces; ++i) s += String(std::string(nPiece - 1, char('a' + i % 26)).append(1, ' ').c_str());
+		String::Coalesce(128, 32);
+
+		return s;
+	}
+
+	void run()
+	{
+		auto const a = rope(20000, 16), b = rope(20000, 16) + "x"_s, c = rope(10000, 16) + rope(10000, 16);
+
+		Measure("Compare two ropes that differ at the end", 200, [&]() { auto n = a.Compare(b); Keep(&n); });
+		Count("Compare two ropes that differ at the end", 200, [&]() { auto n = a.Compare(b); Keep(&n); });
+		Measure("Equals on two equal ropes cut differently", 200, [&]() { auto n = a.Equals(c); Keep(&n); });
+		Count("Equals on two equal ropes cut differently", 200, [&]() { auto n = a.Equals(c); Keep(&n); });
+		Measure("Compare a rope with a copy of itself", 10000000, [&]() { String d = a; auto n = a.Compare(d); Keep(&n); });
+
+		Measure("Flatten copies of both and strcmp", 200, [&]()
+		{
+			String x = a + "."_s, y = b + "."_s;
+			auto n = strcmp(x, y);
+			Keep(&n);
+		});
+
+		std::string const x(static_cast<char const*>(a)), y(static_cast<char const*>(b));
+		Measure("std::string::compare of the same bytes", 200, [&]() { auto n = x.compare(y); Keep(&n); });
+	}
+
+	Benchmark compare("compare", run);
+}
@@ -0,0 +1,56 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Reads every code point of a rope of 1 MB in 5000 leaves in order, with a Cursor and with At() at each position, and
+// reads the bytes of the same text in a std::string for comparison.  A cursor steps from byte to byte within a leaf and
+// only climbs the tree between leaves, whereas At() looks each position up from the root.
+
+namespace
+{
+	void run()
+	{
+		String r;
+		std::string line;
+
+		for (int i = 0; line.size() < 200; ++i) line += std::to_string(i) + (i % 3 ? " kissa ja koira\n" : " h\xC3\xA4\xC3\xA4y\xC3\xB6\n");
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 5000; ++i) r += String(line.c_str());
+		String::Coalesce(128, 32);
+
+		std::string const flat(static_cast<char const*>(r + ""_s));
+
+		Measure("Walk 1 MB by code point with a Cursor", 20, [&r]()
+		{
+			Char_t n = 0;
+			for (auto c : r) n += c;
+			Keep(&n);
+		});
+
+		Measure("Walk 1 MB by code point with At()", 20, [&r]()
+		{
+			Char_t n = 0;
+			for (int i = 0, k = r.Length(); i < k; ++i) n += r.At(i);
+			Keep(&n);
+		});
+
+		Measure("Walk 1 MB by code point backwards with a Cursor", 20, [&r]()
+		{
+			Char_t n = 0;
+			for (auto c = r.end(), b = r.begin(); c != b; ) n += *--c;
+			Keep(&n);
+		});
+
+		Measure("Walk 1 MB by byte in a std::string", 20, [&flat]()
+		{
+			char n = 0;
+			for (auto c : flat) n += c;
+			Keep(&n);
+		});
+	}
+
+	Benchmark cursor("cursor", run);
+}
@@ -0,0 +1,61 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Hands one rope to several threads that only read it: each through a copy of its own, which needs no preparation,
+// and all through one published handle.  The reads are of what the nodes work out lazily, the length, the hash and the
+// flat bytes, so the timings on one thread are those of the caches, and on more threads those of sharing them.
+
+namespace
+{
+	String rope()
+	{
+		String s;
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 1000; ++i) s += String(std::string(20 + i % 7, char('a' + i % 26)).c_str());
+		String::Coalesce(128, 32);
+
+		return s;
+	}
+
+	void run()
+	{
+		auto const nMax = std::max(4u, std::thread::hardware_concurrency());
+
+		for (unsigned n = 1; n <= nMax; n *= 2)
+		{
+			auto const shared = rope();
+
+			Parallel("Copy, then read the length, the hash and the bytes of the copy", n, 1000000, [&shared](unsigned, size_t nRounds)
+			{
+				for (size_t i = 0; i < nRounds; ++i)
+				{
+					String s = shared;
+					auto n = s.Length() + s.Hash() + static_cast<char const*>(s)[0];
+					Keep(&n);
+				}
+			});
+		}
+
+		for (unsigned n = 1; n <= nMax; n *= 2)
+		{
+			auto const published = rope();
+			published.Publish();
+
+			Parallel("Read the length, the hash and the bytes of one published handle", n, 1000000, [&published](unsigned, size_t nRounds)
+			{
+				for (size_t i = 0; i < nRounds; ++i)
+				{
+					auto n = published.Length() + published.Hash() + static_cast<char const*>(published)[0];
+					Keep(&n);
+				}
+			});
+		}
+	}
+
+	Benchmark fanout("fanout", run);
+}
@@ -0,0 +1,47 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Copies ropes of 1 MB into one buffer with Get(), which walks the tree, next to a memcpy() of the same bytes.  One rope
+// is built from both ends at once, so its tree is balanced from the start, and the other by prepending, which without
+// rebalancing would be a list.  Both have 50000 leaves of 20 bytes.
+
+namespace
+{
+	String build(bool bPrepend)
+	{
+		String s;
+
+		String::Coalesce(0, 0);
+
+		for (int i = 0; i < 50000; ++i)
+		{
+			std::string piece(20, char('a' + i % 26));
+
+			if (bPrepend) s = String(piece.c_str()) + std::move(s);
+			else s = i % 2 ? std::move(s) + String(piece.c_str()) : String(piece.c_str()) + std::move(s);
+		}
+
+		String::Coalesce(128, 32);
+		return s;
+	}
+
+	void run()
+	{
+		auto const balanced = build(false), prepended = build(true);
+		std::vector<char> buffer(balanced.Size() + 1);
+		std::string const flat(balanced.Size(), 'x');
+
+		std::cout << "Depth " << balanced.Depth() << " and " << prepended.Depth() << std::endl;
+
+		Measure("Get() 1 MB in 50000 leaves, built from both ends", 100, [&]() { balanced.Get(buffer.data(), buffer.size()); Keep(buffer.data()); });
+		Measure("Get() 1 MB in 50000 leaves, built by prepending", 100, [&]() { prepended.Get(buffer.data(), buffer.size()); Keep(buffer.data()); });
+		Measure("Flatten a new copy of 1 MB in 50000 leaves", 100, [&]() { String s = prepended + "."_s; Keep(static_cast<char const*>(s)); });
+		Measure("memcpy() 1 MB", 100, [&]() { memcpy(buffer.data(), flat.data(), flat.size()); Keep(buffer.data()); });
+	}
+
+	Benchmark flatten("flatten", run);
+}
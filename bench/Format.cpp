@@ -0,0 +1,54 @@
+#include "Bench.h"
+
+#include <stdio.h>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Applies message templates with short and long arguments, next to snprintf() into a buffer and to std::string
+// concatenation, and looks formats up in a catalog.
+
+namespace
+{
+	void formatting()
+	{
+		String::Format const format("Copied {1} files to {0} in {2} seconds");
+		String const folder("C:\\Users\\kissa\\Documents\\Projects"), count("1234"), seconds("5.6");
+		String const longFolder(std::string(2000, 'k').c_str());
+
+		Measure("Format with three short arguments", 1000000, [&]() { auto s = format(folder, count, seconds); Keep(&s); });
+		Measure("Format with an argument of 2000 bytes", 1000000, [&]() { auto s = format(longFolder, count, seconds); Keep(&s); });
+		Measure("Format with three short arguments and flatten", 1000000, [&]() { auto s = format(folder, count, seconds); Keep(static_cast<char const*>(s)); });
+
+		Measure("snprintf with three short arguments", 1000000, []()
+		{
+			char cBuffer[128];
+			snprintf(cBuffer, sizeof cBuffer, "Copied %s files to %s in %s seconds", "1234", "C:\\Users\\kissa\\Documents\\Projects", "5.6");
+			Keep(cBuffer);
+		});
+
+		std::string const longText(2000, 'k');
+		Measure("std::string concatenation with an argument of 2000 bytes", 1000000, [&longText]()
+		{
+			auto s = "Copied " + std::string("1234") + " files to " + longText + " in " + "5.6" + " seconds";
+			Keep(&s);
+		});
+	}
+
+	void looking()
+	{
+		std::string text;
+		for (int i = 0; i < 1000; ++i) text += "message" + std::to_string(i) + " = Viesti " + std::to_string(i) + ": {0} ja {1}\n";
+
+		String const source(text.c_str());
+
+		Measure("Parse a catalog of 1000 formats", 100, [&source]() { String::Catalog c(source); Keep(&c); });
+
+		String::Catalog const catalog(source);
+		String const key("message500"), a("kissa"), b("koira");
+
+		Measure("Look up a format and apply it", 1000000, [&]() { auto s = catalog[key](a, b); Keep(&s); });
+	}
+
+	Benchmark format("format", []() { formatting(); looking(); });
+}
@@ -0,0 +1,51 @@
+#include "Bench.h"
+
+#include <string>
+#include <string_view>
+
+//**********************************************************************************************************************
+
+// Hashes ropes, whose concatenations keep their hashes once known, and flat strings, whose leaves work theirs out each
+// time, next to std::hash of the same bytes.
+
+namespace
+{
+	String rope(size_t nPieces, size_t nPiece)
+	{
+		String s;
+
+		String::Coalesce(0, 0);
+		for (size_t i = 0; i < nPieces; ++i) s += String(std::string(nPiece - 1, char('a' + i % 26)).append(1, ' ').c_str());
+		String::Coalesce(128, 32);
+
+		return s;
+	}
+
+	void run()
+	{
+		auto const a = rope(20000, 16);
+
+		Measure("Hash a new concatenation of a hashed rope", 1000000, [&a]()
+		{
+			auto n = (a + "x"_s).Hash();
+			Keep(&n);
+		});
+
+		Measure("Build and hash a rope of 20000 pieces", 100, []()
+		{
+			auto n = rope(20000, 16).Hash();
+			Keep(&n);
+		});
+
+		std::string const flat(static_cast<char const*>(a));
+		String const leaf(flat.c_str());
+
+		Measure("Hash a flat string of 320 KB", 1000, [&leaf]() { auto n = leaf.Hash(); Keep(&n); });
+		Measure("std::hash of the same bytes", 1000, [&flat]() { auto n = std::hash<std::string_view>()(flat); Keep(&n); });
+
+		String const word("kissan paksut posket");
+		Measure("Hash a flat string of 20 bytes", 10000000, [&word]() { auto n = word.Hash(); Keep(&n); });
+	}
+
+	Benchmark hash("hash", run);
+}
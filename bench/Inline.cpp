@@ -0,0 +1,42 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Makes strings of up to 14 bytes, which are kept in the handle, and one byte longer ones, which need a node, in the
+// ways that programs make them: from char const*, by concatenating, and by slicing a rope.  Each is timed and counted.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		String rope;
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 1000; ++i) rope += String((std::to_string(i) + " kissa ja koira ").c_str());
+		String::Coalesce(128, 32);
+
+		auto const length = rope.Length();
+		String const seven("1234567"), eight("12345678");
+
+		both("Create 14 bytes", 10000000, []() { String s("12345678901234"); Keep(&s); });
+		both("Create 15 bytes", 10000000, []() { String s("123456789012345"); Keep(&s); });
+
+		both("Concatenate 7 and 7 bytes", 10000000, [&]() { auto s = seven + seven; Keep(&s); });
+		both("Concatenate 7 and 8 bytes", 10000000, [&]() { auto s = seven + eight; Keep(&s); });
+
+		both("Head of 14 bytes of a rope of 1000 pieces", 1000000, [&]() { auto s = rope.Head(14); Keep(&s); });
+		both("Head of 15 bytes of a rope of 1000 pieces", 1000000, [&]() { auto s = rope.Head(15); Keep(&s); });
+		both("Tail of 14 bytes of a rope of 1000 pieces", 1000000, [&]() { auto s = rope.Tail(length - 14); Keep(&s); });
+		both("Tail of 15 bytes of a rope of 1000 pieces", 1000000, [&]() { auto s = rope.Tail(length - 15); Keep(&s); });
+	}
+
+	Benchmark inline_("inline", run);
+}
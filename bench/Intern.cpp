@@ -0,0 +1,40 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Creates 100000 strings from char const*, drawn from 1000 keys of 16 to 47 bytes, and keeps them all, with interning
+// on and off.  With it on, equal keys share one buffer, so the blocks and bytes counted are those of the distinct keys
+// only, at the price of a lookup in the table for each string.
+
+namespace
+{
+	void run()
+	{
+		std::vector<std::string> keys;
+		for (int i = 0; i < 1000; ++i) keys.push_back("tag:" + std::to_string(i * 7919) + std::string(size_t(11 + i % 26), 'k'));
+
+		for (size_t limit : { 0, 64 })
+		{
+			auto const szWhat = limit ? "Create 100000 strings of 1000 keys, interned" : "Create 100000 strings of 1000 keys";
+
+			String::Intern(limit);
+
+			auto create = [&keys]()
+			{
+				std::vector<String> v;
+				v.reserve(100000);
+				for (size_t i = 0; i < 100000; ++i) v.emplace_back(keys[i * 7 % keys.size()].c_str());
+				Keep(v.data());
+			};
+
+			Measure(szWhat, 20, create);
+			Count(szWhat, 20, create);
+		}
+
+		String::Intern(0);
+	}
+
+	Benchmark intern("intern", run);
+}
@@ -0,0 +1,28 @@
+#include "Bench.h"
+
+//**********************************************************************************************************************
+
+// Concatenates a literal of 29 bytes with a string of 36 bytes, made from the literal with operator""_s and from
+// char const*, which measures, allocates and copies the literal each time.  Each is timed and counted.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		String const s("Mustan kissan paksut posket, h\xC3\xA4\xC3\xA4y\xC3\xB6");
+
+		both("Make a literal of 29 bytes", 10000000, []() { String r = "kissa ja koira, joka on musta"_s; Keep(&r); });
+		both("Make a string of 29 bytes from char const*", 10000000, []() { String r("kissa ja koira, joka on musta"); Keep(&r); });
+
+		both("Concatenate a literal of 29 bytes", 10000000, [&s]() { auto r = "kissa ja koira, joka on musta"_s + s; Keep(&r); });
+		both("Concatenate 29 bytes from char const*", 10000000, [&s]() { auto r = String("kissa ja koira, joka on musta") + s; Keep(&r); });
+	}
+
+	Benchmark literal("literal", run);
+}
@@ -0,0 +1,100 @@
+#include "Bench.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+//**********************************************************************************************************************
+
+// Maps windows of a file twice the size of the memory of the machine and slices them, next to reading the same windows
+// into a std::string.  The file is sparse: 1 MB of text at each of 16 places and holes between them, which read as
+// zeros.  On a file system without sparse files the holes take up disk space as well.
+
+namespace
+{
+	char const* const szPath = "bench.tmp";
+
+	unsigned long long memory()
+	{
+#if defined(_WIN32)
+		MEMORYSTATUSEX status;
+		status.dwLength = sizeof status;
+		return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+#else
+		return static_cast<unsigned long long>(sysconf(_SC_PHYS_PAGES)) * static_cast<unsigned long long>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	void run()
+	{
+		auto const nFile = std::max(2 * memory(), 8ULL << 30);
+		auto const nStride = nFile / 16;
+		size_t const nWindow = 1 << 20;
+
+		std::string text;
+		for (int i = 0; text.size() < nWindow; ++i) text += std::to_string(i) + (i % 3 ? " kissa ja koira\n" : " h\xC3\xA4\xC3\xA4y\xC3\xB6\n");
+		text.resize(nWindow);
+
+		{
+			std::ofstream file(szPath, std::ios::binary);
+
+			for (int i = 0; i < 16; ++i)
+			{
+				file.seekp(std::streamoff(i * nStride));
+				file.write(text.data(), std::streamsize(nWindow));
+			}
+
+			file.seekp(std::streamoff(nFile - 1));
+			file.write("\n", 1);
+			if (!file) throw "Map: The sparse file could not be written.";
+		}
+
+		std::cout << "File of " << (nFile >> 20) << " MB, memory of " << (memory() >> 20) << " MB" << std::endl;
+
+		int i = 0;
+
+		Measure("Map a 1 MB window and count its code points", 1000, [&]()
+		{
+			auto r = String::FromFile(szPath, ++i % 16 * nStride, nWindow);
+			auto n = r.Length();
+			Keep(&n);
+		});
+
+		Measure("Map a 1 MB window and slice 100 code points from its middle", 1000, [&]()
+		{
+			auto r = String::FromFile(szPath, ++i % 16 * nStride, nWindow);
+			auto s = r.Tail(r.Length() / 2).Head(100);
+			Keep(&s);
+		});
+
+		Measure("Read a 1 MB window into a std::string", 1000, [&]()
+		{
+			std::ifstream file(szPath, std::ios::binary);
+			std::string r(nWindow, '\0');
+
+			file.seekg(std::streamoff(++i % 16 * nStride));
+			file.read(&r[0], std::streamsize(nWindow));
+			Keep(&r);
+		});
+
+		Measure("Map a 1 GB window and slice 100 code points from its middle", 5, [&]()
+		{
+			auto r = String::FromFile(szPath, ++i % 8 * nStride, 1 << 30);
+			auto s = r.Tail(r.Length() / 2).Head(100);
+			Keep(&s);
+		});
+
+		remove(szPath);
+	}
+
+	Benchmark map("map", run);
+}
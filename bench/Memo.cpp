@@ -0,0 +1,38 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Counts what flat copies cost.  Leaves with a buffer of their own do not carry the space for one, so the first lines
+// give the bytes of leaves of a few sizes.  Then a handle flattens a node that another handle holds, which takes the
+// copy that the node keeps, next to a node that is new each round, which has to be copied.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		std::string const text(1000, 'x');
+
+		for (size_t n : { 15, 30, 60, 120 })
+		{
+			auto const name = "Make a string of " + std::to_string(n) + " bytes";
+			auto const p = text.c_str() + text.size() - n;
+
+			both(name.c_str(), 1000000, [p]() { String s(p); Keep(&s); });
+		}
+
+		String const node = String('a', 500) + String('b', 500);
+
+		both("Flatten a node that is held elsewhere", 1000000, [&node]() { String s = node; Keep(static_cast<char const*>(s)); });
+		both("Flatten a new node", 1000000, []() { String s = String('a', 500) + String('b', 500); Keep(static_cast<char const*>(s)); });
+	}
+
+	Benchmark memo("memo", run);
+}
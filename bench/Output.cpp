@@ -0,0 +1,52 @@
+#include "Bench.h"
+
+#include <stdio.h>
+#include <string>
+
+#if defined(_WIN32)
+#include <io.h>
+#define fileno _fileno
+#endif
+
+//**********************************************************************************************************************
+
+// Writes a rope of 5000 pieces to the null device, each piece in place, next to flattening a copy and writing that,
+// which is what callers did before.
+
+namespace
+{
+	void run()
+	{
+		String r;
+		std::string line;
+		for (int i = 0; line.size() < 200; ++i) line += std::to_string(i) + (i % 3 ? " kissa ja koira\n" : " h\xC3\xA4\xC3\xA4y\xC3\xB6\n");
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 5000; ++i) r += String(line.c_str());
+		String::Coalesce(128, 32);
+
+#if defined(_WIN32)
+		auto file = fopen("NUL", "wb");
+#else
+		auto file = fopen("/dev/null", "wb");
+#endif
+		if (!file) throw "Output: The null device could not be opened.";
+		auto fd = fileno(file);
+
+		Measure("WriteTo 1 MB in 5000 pieces", 100, [&r, fd]()
+		{
+			if (!r.WriteTo(fd)) throw "Output: Writing failed.";
+		});
+
+		Measure("Flatten a copy of 1 MB in 5000 pieces and write it", 100, [&r, file]()
+		{
+			String s = r + "\n"_s;
+			fwrite(static_cast<char const*>(s), 1, s.Size(), file);
+			fflush(file);
+		});
+
+		fclose(file);
+	}
+
+	Benchmark output("output", run);
+}
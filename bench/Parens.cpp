@@ -0,0 +1,32 @@
+#include "Bench.h"
+
+//**********************************************************************************************************************
+
+// The loops at the end of main.cpp, which wrap a string in 100 parentheses at the front, the back and both ends.  Each
+// is run as it is written there, copying the string and the parentheses, next to the same with the string moved
+// through or appended to and the parentheses as literals.  A round is one whole loop, timed and counted.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		String const start = String("Hello") + String("World, kissa ja koira");
+
+		both("sum = \"(\" + sum", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum = "(" + sum; Keep(&sum); });
+		both("sum = \"(\"_s + std::move(sum)", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum = "("_s + std::move(sum); Keep(&sum); });
+
+		both("sum = sum + \")\"", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum = sum + ")"; Keep(&sum); });
+		both("sum += \")\"_s", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum += ")"_s; Keep(&sum); });
+
+		both("sum = \"(\" + sum + \")\"", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum = "(" + sum + ")"; Keep(&sum); });
+		both("sum = \"(\"_s + std::move(sum) + \")\"_s", 10000, [&start]() { String sum = start; for (int i = 0; i < 100; ++i) sum = "("_s + std::move(sum) + ")"_s; Keep(&sum); });
+	}
+
+	Benchmark parens("parens", run);
+}
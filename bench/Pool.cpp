@@ -0,0 +1,26 @@
+#include "Bench.h"
+
+#include <new>
+
+//**********************************************************************************************************************
+
+// Slices and concatenates strings and destroys the results at once, which is mostly the work of allocating and freeing
+// nodes from the pools.  A heap allocation of the size of a node is timed for comparison.
+
+namespace
+{
+	void run()
+	{
+		String const base = String('x', 100) + String('y', 100);
+
+		Measure("Slice and destroy", 10000000, [&base]() { auto s = base.Tail(7).Head(150); Keep(&s); });
+		Count("Slice and destroy", 1000000, [&base]() { auto s = base.Tail(7).Head(150); Keep(&s); });
+
+		Measure("Concatenate and destroy", 10000000, [&base]() { auto s = base + base; Keep(&s); });
+		Count("Concatenate and destroy", 1000000, [&base]() { auto s = base + base; Keep(&s); });
+
+		Measure("Heap new and delete of 112 bytes", 10000000, []() { auto p = ::operator new(112); Keep(p); ::operator delete(p); });
+	}
+
+	Benchmark pool("pool", run);
+}
@@ -0,0 +1,134 @@
+#include "Bench.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+//**********************************************************************************************************************
+
+// Reads 16 MB into a string from an istream, from a file, and from a pipe that another thread writes in 64 KB pieces,
+// which is where reading does not know the size ahead.  Each has a plain C++ counterpart through a std::string.
+
+namespace
+{
+	char const* const szPath = "bench.tmp";
+	size_t const PIECE = 65536;
+
+	std::string text(size_t n)
+	{
+		std::string s;
+		for (int i = 0; s.size() < n; ++i) s += std::to_string(i) + (i % 3 ? " kissa ja koira\n" : " h\xC3\xA4\xC3\xA4y\xC3\xB6\n");
+		return s;
+	}
+
+	// Calls read(fd) on the reading end of a pipe while another thread writes s into it.
+
+	template <typename F> void piped(std::string const& s, F&& read)
+	{
+		int fd[2];
+#if defined(_WIN32)
+		if (_pipe(fd, unsigned(PIECE), _O_BINARY)) throw "Read: The pipe could not be created.";
+#else
+		if (pipe(fd)) throw "Read: The pipe could not be created.";
+#endif
+		std::thread writer([&s, fd]()
+		{
+			for (size_t i = 0; i < s.size(); i += PIECE)
+			{
+				auto n = std::min(PIECE, s.size() - i);
+#if defined(_WIN32)
+				_write(fd[1], s.data() + i, unsigned(n));
+#else
+				for (size_t k = 0; k < n; ) { auto r = ::write(fd[1], s.data() + i + k, n - k); if (r <= 0) break; k += size_t(r); }
+#endif
+			}
+#if defined(_WIN32)
+			_close(fd[1]);
+#else
+			close(fd[1]);
+#endif
+		});
+
+		read(fd[0]);
+		writer.join();
+#if defined(_WIN32)
+		_close(fd[0]);
+#else
+		close(fd[0]);
+#endif
+	}
+
+	void run()
+	{
+		auto const s = text(16 << 20);
+
+		Measure("Read 16 MB from an istream", 10, [&s]()
+		{
+			std::istringstream stream(s);
+			auto r = String::Read(stream);
+			Keep(&r);
+		});
+
+		Measure("Read 16 MB from an istream into a std::string", 10, [&s]()
+		{
+			std::istringstream stream(s);
+			std::string r(std::istreambuf_iterator<char>(stream), {});
+			Keep(&r);
+		});
+
+		std::ofstream(szPath, std::ios::binary).write(s.data(), std::streamsize(s.size()));
+
+		Measure("Read 16 MB from a file descriptor", 10, []()
+		{
+			auto file = fopen(szPath, "rb");
+			if (!file) throw "Read: The file could not be opened.";
+			auto r = String::Read(fileno(file));
+			fclose(file);
+			Keep(&r);
+		});
+
+		Measure("Read 16 MB from a file with an ifstream into a std::string", 10, []()
+		{
+			std::ifstream file(szPath, std::ios::binary);
+			std::string r(std::istreambuf_iterator<char>(file), {});
+			Keep(&r);
+		});
+
+		remove(szPath);
+
+		Measure("Read 16 MB from a pipe", 10, [&s]()
+		{
+			piped(s, [](int fd) { auto r = String::Read(fd); if (r.Size() < 16 << 20) throw "Read: The pipe was cut short."; Keep(&r); });
+		});
+
+		Measure("Read 16 MB from a pipe into a std::string", 10, [&s]()
+		{
+			piped(s, [](int fd)
+			{
+				std::string r;
+				char c[PIECE];
+#if defined(_WIN32)
+				for (int n; (n = _read(fd, c, unsigned(PIECE))) > 0; ) r.append(c, size_t(n));
+#else
+				for (ssize_t n; (n = ::read(fd, c, PIECE)) > 0; ) r.append(c, size_t(n));
+#endif
+				Keep(&r);
+			});
+		});
+
+		Count("Read 16 MB from a pipe", 5, [&s]() { piped(s, [](int fd) { auto r = String::Read(fd); Keep(&r); }); });
+	}
+
+	Benchmark reading("read", run);
+}
@@ -0,0 +1,46 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Searches ropes in place, next to the same work done on a flattened copy, which is what callers did before.  The ropes
+// are made of many short pieces, where in-place work has the most to lose.
+
+namespace
+{
+	String rope(size_t nPieces, size_t nPiece)
+	{
+		String s;
+
+		String::Coalesce(0, 0);
+		for (size_t i = 0; i < nPieces; ++i) s += String(std::string(nPiece - 1, char('a' + i % 26)).append(1, ' ').c_str());
+		String::Coalesce(128, 32);
+
+		return s;
+	}
+
+	void searching()
+	{
+		auto const haystack = rope(20000, 16);
+		auto const shortNeedle = String("zzzz zz");
+		auto const longNeedle = String(std::string(1000, 'q').c_str());
+
+		Measure("Find a missing 7-byte needle in 20000 pieces", 200, [&]() { auto n = haystack.Find(shortNeedle); Keep(&n); });
+		Measure("Find a missing 1000-byte needle in 20000 pieces", 200, [&]() { auto n = haystack.Find(longNeedle); Keep(&n); });
+		Measure("RFind a missing 7-byte needle in 20000 pieces", 200, [&]() { auto n = haystack.RFind(shortNeedle); Keep(&n); });
+
+		Measure("Flatten a copy and strstr a missing 7-byte needle", 200, [&]()
+		{
+			String copy = haystack + "."_s;
+			auto p = strstr(copy, "zzzz zz");
+			Keep(&p);
+		});
+
+		std::string const flat(static_cast<char const*>(haystack));
+		Measure("std::string::find a missing 7-byte needle", 200, [&flat]() { auto n = flat.find("zzzz zz"); Keep(&n); });
+	}
+
+	Benchmark search("search", searching);
+}
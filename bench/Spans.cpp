@@ -0,0 +1,50 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Goes over the pieces of 1 MB in 5000 leaves, and of 1 MB of one repeated character, which comes in chunks, and copies
+// them out, next to Get() of the same strings into one buffer.
+
+namespace
+{
+	void pieces(char const* szWhat, String const& s, std::vector<char>& buffer)
+	{
+		std::cout << "Of " << szWhat << ":" << std::endl;
+
+		Measure("  Visit the pieces", 1000, [&s]()
+		{
+			size_t n = 0;
+			s.Visit([&n](std::string_view v) { n += v.size(); });
+			Keep(&n);
+		});
+
+		Measure("  Copy the pieces one by one", 100, [&s, &buffer]()
+		{
+			auto q = buffer.data();
+			for (auto piece : s.Spans()) { memcpy(q, piece.data(), piece.size()); q += piece.size(); }
+			Keep(q);
+		});
+
+		Measure("  Get()", 100, [&s, &buffer]() { s.Get(buffer.data(), buffer.size()); Keep(buffer.data()); });
+	}
+
+	void run()
+	{
+		String leaves;
+		std::string const line(200, 'k');
+
+		String::Coalesce(0, 0);
+		for (int i = 0; i < 5000; ++i) leaves += String(line.c_str());
+		String::Coalesce(128, 32);
+
+		std::vector<char> buffer(leaves.Size() + 1);
+
+		pieces("5000 leaves", leaves, buffer);
+		pieces("a repeated character", String(0x00E4, 500000), buffer);
+	}
+
+	Benchmark spans("spans", run);
+}
@@ -0,0 +1,128 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Copies and destroys shared ropes on several threads at once, and hands strings from the threads that build them to
+// threads that destroy them.  Besides the timings it checks the lengths that it sees, since a reference count that goes
+// wrong under contention usually shows up as a string that has changed under its holder.
+
+namespace
+{
+	std::vector<String> ropes(size_t n)
+	{
+		std::vector<String> v;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			String head(std::string(100 + i, char('a' + i % 26)).c_str());
+			String tail(std::to_string(i * 7919).c_str());
+
+			v.push_back(head + tail + head.Head(50));
+		}
+
+		return v;
+	}
+
+	void run()
+	{
+		auto const v = ropes(64);
+		auto const nMax = std::max(4u, std::thread::hardware_concurrency());
+		std::atomic<size_t> nWrong{ 0 };
+
+		Measure("Copy and destroy on the creating thread", 10000000, [&v]() { String s(v[0]); Keep(&s); });
+
+		for (unsigned n = 1; n <= nMax; n *= 2)
+		{
+			Parallel("Copy and destroy one rope", n, 2000000, [&v](unsigned, size_t nRounds)
+			{
+				for (size_t i = 0; i < nRounds; ++i) { String s(v[0]); Keep(&s); }
+			});
+		}
+
+		for (unsigned n = 1; n <= nMax; n *= 2)
+		{
+			Parallel("Copy, concatenate, slice and destroy ropes", n, 200000, [&v, &nWrong](unsigned nThread, size_t nRounds)
+			{
+				auto r = nThread * 2654435761u + 1;
+
+				for (size_t i = 0; i < nRounds; ++i)
+				{
+					r = r * 1103515245 + 12345;
+
+					String a = v[(r >> 8) % v.size()];
+					String b = a + v[(r >> 16) % v.size()];
+					String c = b.Tail(a.Length());
+
+					if (c.Length() != b.Length() - a.Length()) ++nWrong;
+					Keep(&c);
+				}
+			});
+		}
+
+		// Each builder thread fills a queue that one destroyer thread empties, so that every string is let go of by a
+		// thread other than the one that created it.
+
+		for (unsigned n = 1; 2 * n <= nMax; n *= 2)
+		{
+			struct Queue
+			{
+				std::mutex mutex;
+				std::condition_variable ready;
+				std::deque<String> items;
+				bool bDone = false;
+			};
+
+			std::vector<Queue> queues(n);
+
+			Parallel("Build on one thread and destroy on another", 2 * n, 200000, [&v, &nWrong, &queues](unsigned nThread, size_t nRounds)
+			{
+				auto& queue = queues[nThread / 2];
+
+				if (nThread % 2 == 0)
+				{
+					for (size_t i = 0; i < nRounds; ++i)
+					{
+						String s = v[i % v.size()] + v[(i + 1) % v.size()];
+						std::lock_guard<std::mutex> lock(queue.mutex);
+
+						queue.items.push_back(std::move(s));
+						queue.ready.notify_one();
+					}
+
+					std::lock_guard<std::mutex> lock(queue.mutex);
+
+					queue.bDone = true;
+					queue.ready.notify_one();
+					return;
+				}
+
+				for (size_t i = 0; ; ++i)
+				{
+					String s;
+					{
+						std::unique_lock<std::mutex> lock(queue.mutex);
+
+						queue.ready.wait(lock, [&queue]() { return queue.bDone || !queue.items.empty(); });
+						if (queue.items.empty()) break;
+
+						s = std::move(queue.items.front());
+						queue.items.pop_front();
+					}
+
+					if (s.Length() != v[i % v.size()].Length() + v[(i + 1) % v.size()].Length()) ++nWrong;
+				}
+			});
+		}
+
+		if (nWrong) throw "Threads: A string had the wrong length.";
+	}
+
+	Benchmark threads("threads", run);
+}
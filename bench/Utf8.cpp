@@ -0,0 +1,55 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <string>
+
+//**********************************************************************************************************************
+
+// Counts the code points of 1 MB of English, Finnish and Chinese text, which in UTF-8 are all ASCII, mostly ASCII with
+// some two byte sequences, and mostly three byte sequences.  A new string counts them when first asked for its length.
+
+namespace
+{
+	std::string text(size_t n, char const* szWords)
+	{
+		std::string s;
+		while (s.size() <= n) s += szWords;
+		while ((s[n] & 0xC0) == 0x80) --n;  // Cut between code points
+		s.resize(n);
+		return s;
+	}
+
+	// Strings are created in batches, and only asking each of them for its length is timed, so the fastest batch gives
+	// the rate of counting alone.
+
+	void count(char const* szWhat, std::string const& s)
+	{
+		double tBest = 1e300;
+
+		for (int i = 0; i < 20; ++i)
+		{
+			std::vector<String> v(32, String(""));
+			for (auto& r : v) r = String(s.c_str());
+
+			auto t = std::chrono::steady_clock::now();
+			for (auto& r : v) { auto n = r.Length(); Keep(&n); }
+			std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - t;
+
+			tBest = std::min(tBest, d.count() / v.size());
+		}
+
+		std::cout << szWhat << ": " << s.size() / tBest << " GB/s" << std::endl;
+	}
+
+	void run()
+	{
+		count("ASCII", text(1 << 20, "The quick brown fox jumps over the lazy dog. "));
+		count("Latin-1", text(1 << 20, "Mustan kissan paksut posket, h\xC3\xA4\xC3\xA4y\xC3\xB6 ja \xC3\xA5ngstr\xC3\xB6m. "));
+		count("CJK", text(1 << 20, "\xE6\x97\xA9\xE4\xB8\x8A\xE5\xA5\xBD\xEF\xBC\x8C\xE4\xBB\x8A\xE5\xA4\xA9\xE5\xA4\xA9\xE6\xB0\x94\xE5\xBE\x88\xE5\xA5\xBD\xE3\x80\x82 "));
+
+		String const big(text(1 << 20, "h\xC3\xA4\xC3\xA4y\xC3\xB6 ").c_str());
+		Measure("Length of 1 MB, counted before", 1000000, [&big]() { auto n = big.Length(); Keep(&n); });
+	}
+
+	Benchmark utf8("utf8", run);
+}
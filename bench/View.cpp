@@ -0,0 +1,32 @@
+#include "Bench.h"
+
+#include <string>
+
+//**********************************************************************************************************************
+
+// Slices a leaf of 300 bytes, and reads the bytes of the slice with View(), which finds them in the leaf, next to
+// operator char const*, which copies them for a terminating NUL.  Each is timed and counted.
+
+namespace
+{
+	template <typename F> void both(char const* szWhat, size_t n, F&& f)
+	{
+		Measure(szWhat, n, f);
+		Count(szWhat, n, f);
+	}
+
+	void run()
+	{
+		std::string text;
+		for (int i = 0; i < 20; ++i) text += "h\xC3\xA4\xC3\xA4y\xC3\xB6 kissa ";
+
+		String const leaf(text.c_str());
+
+		both("View() a head of 150 code points", 1000000, [&leaf]() { auto s = leaf.Head(150); auto v = s.View(); Keep(v.data()); });
+		both("operator char const* on a head of 150 code points", 1000000, [&leaf]() { auto s = leaf.Head(150); Keep(static_cast<char const*>(s)); });
+		both("View() a head of a tail", 1000000, [&leaf]() { auto s = leaf.Tail(50).Head(100); auto v = s.View(); Keep(v.data()); });
+		both("operator char const* on a head of a tail", 1000000, [&leaf]() { auto s = leaf.Tail(50).Head(100); Keep(static_cast<char const*>(s)); });
+	}
+
+	Benchmark view("view", run);
+}
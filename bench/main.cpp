@@ -0,0 +1,32 @@
+#include "Bench.h"
+
+#include <atomic>
+#include <cstring>
+
+void Keep(void const* p) noexcept
+{
+	static std::atomic<void const*> pLast;
+	pLast.store(p, std::memory_order_relaxed);
+}
+
+int main(int argc, char** argv) try
+{
+	int count = 0;
+
+	for (auto p : Benchmark::all())
+	{
+		if (argc > 1 && strcmp(argv[1], p->szName)) continue;
+
+		std::cout << "[" << p->szName << "]" << std::endl;
+		p->pRun();
+		++count;
+	}
+
+	if (!count) std::cout << "No benchmark is called '" << argv[1] << "'." << std::endl;
+	return count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (char const* p)
+{
+	std::cout << std::endl << p << std::endl;
+	return EXIT_FAILURE;
+}
@@ -2,7 +2,21 @@
 #include "Tekstaus.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#define fileno _fileno
+#endif
 
 using std::cout;
 using std::endl;
@@ -13,6 +27,55 @@ void evaluate(char const*p)
 	// cout << p << endl;
 }
 
+// Code points in the first n bytes of s, and bytes in its first n code points, to compare String positions with
+// std::string ones.
+
+int points(std::string const& s, size_t n)
+{
+	int k = 0;
+	for (size_t i = 0; i < n && i < s.size(); ++i) k += (s[i] & 0xC0) != 0x80;
+	return k;
+}
+
+size_t bytes(std::string const& s, int n)
+{
+	size_t i = 0;
+	for (int k = 0; i < s.size(); ++i) if ((s[i] & 0xC0) != 0x80 && k++ == n) break;
+	return i;
+}
+
+// The bytes of s as a rope of pieces of uneven sizes, cut between code points only.
+
+String rope(std::string const& s, size_t nStep)
+{
+	String r;
+
+	for (size_t i = 0, n = nStep; i < s.size(); i += n, n = n % 13 + nStep)
+	{
+		while (i + n < s.size() && (s[i + n] & 0xC0) == 0x80) ++n;
+		r += String(s.substr(i, n).c_str());
+	}
+
+	return r;
+}
+
+std::string flat(String const& r)
+{
+	std::string s(r.Size() + 1, '\0');
+	r.Get(&s[0], s.size());
+	s.pop_back();
+	return s;
+}
+
+// Non-empty pieces that s is made of.
+
+int count(String const& s)
+{
+	int k = 0;
+	for (auto piece : s.Spans()) k += !piece.empty();
+	return k;
+}
+
 int test0()
 {
 	String a;
@@ -45,6 +108,732 @@ int test0()
 	return EXIT_SUCCESS;
 }
 
+// Strings of up to 14 bytes are kept in the handle, however they were made, and a pointer into one lasts as long as the
+// handle does.
+
+int testInline()
+{
+	std::string const text = "h\xC3\xA4\xC3\xA4y\xC3\xB6 kissa ja koira \xF0\x9F\x98\x80";
+	auto const length = points(text, text.size());
+
+	for (int k = 0; k <= length; ++k)
+	{
+		auto const head = text.substr(0, bytes(text, k)), tail = text.substr(bytes(text, k));
+		auto const r = rope(text, 3);
+
+		for (auto& pair : { std::make_pair(String(head.c_str()), head), std::make_pair(r.Head(k), head), std::make_pair(r.Tail(k), tail) })
+		{
+			auto& s = pair.first;
+
+			assert(flat(s) == pair.second);
+			assert(s.Size() == pair.second.size());
+			assert(s.Length() == points(pair.second, pair.second.size()));
+			assert((s.Depth() == 0) == (s.Size() <= 14));
+		}
+	}
+
+	assert(String("12345678901234").Depth() == 0);
+	assert(String("123456789012345").Depth() > 0);
+	assert(String("1234567") + String("1234567") == String("12345671234567"));
+	assert((String("1234567") + String("1234567")).Depth() == 0);
+	assert((String("1234567") + String("12345678")).Depth() > 0);
+
+	auto const sum = String("\xC3\xA4\xC3\xA4") + String("\xF0\x9F\x98\x80");
+	assert(sum.Length() == 3 && sum.Size() == 8 && sum.At(2) == 0x1F600);
+
+	String::Coalesce(0, 0);
+	auto const repeat = String("kissa ") + String(0x1F600, 10);  // 46 bytes in two pieces, the last of them repeated
+	auto const mixed = String("kissa ja koira ") + String(0x00E4, 3);
+	String::Coalesce(128, 32);
+
+	assert(repeat.Tail(13).Depth() == 0 && flat(repeat.Tail(13)) == "\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80");
+	assert(repeat.Tail(12).Depth() > 0 && repeat.Tail(12).Size() == 16);
+	assert(mixed.Depth() > 0 && mixed.Tail(13).Depth() == 0 && flat(mixed.Tail(13)) == "a \xC3\xA4\xC3\xA4\xC3\xA4");
+
+	String s("kissa");
+	auto p = static_cast<char const*>(s);
+	assert(p >= reinterpret_cast<char const*>(&s) && p < reinterpret_cast<char const*>(&s + 1));
+
+	{
+		String t = s;
+		t += String(" ja koira");
+		assert(strcmp(t, "kissa ja koira") == 0);
+	}
+
+	assert(p == static_cast<char const*>(s) && strcmp(p, "kissa") == 0);
+
+	auto const r = rope(text, 3);
+	p = r;
+
+	{
+		String t = r;
+		assert(strcmp(t, text.c_str()) == 0);
+	}
+
+	assert(p == static_cast<char const*>(r) && strcmp(p, text.c_str()) == 0);
+	evaluate(p);
+
+	return EXIT_SUCCESS;
+}
+
+// Strings built in an arena read the same as any others, inside and after its scope, and ones that outlive it keep its
+// memory until the last of them is gone, on whichever thread that is.
+
+int testArena()
+{
+	std::string const text = "h\xC3\xA4\xC3\xA4y\xC3\xB6 kissa ja koira, joka on musta ja valkoinen.";
+	std::vector<String> kept;
+
+	{
+		String::Arena outer;
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			auto const line = std::to_string(i) + " " + text;
+			String s(line.c_str());
+
+			assert(flat(s) == line && s.Length() == points(line, line.size()));
+			if (i % 100 == 0) kept.push_back(s);
+		}
+
+		{
+			String::Arena inner;
+
+			std::string repeat;
+			for (int i = 0; i < 100; ++i) repeat += "\xC3\xA4";
+
+			auto const r = rope(text, 3) + String(0x00E4, 100);
+			assert(strcmp(r, (text + repeat).c_str()) == 0);  // Flattened inside the arena
+			assert(r.Tail(points(text, text.size())) == String(0x00E4, 100));
+
+			kept.push_back(r);
+			kept.push_back(String(text.c_str()) + String(text.c_str()));
+		}
+
+		kept.push_back(String((text + text).c_str()));
+	}
+
+	assert(kept.size() == 13);
+
+	for (size_t i = 0; i < 10; ++i) assert(flat(kept[i]) == std::to_string(i * 100) + " " + text);
+	assert(kept[10].Tail(points(text, text.size())) == String(0x00E4, 100));
+	assert(flat(kept[11]) == text + text && flat(kept[12]) == text + text);
+
+	std::thread([kept = std::move(kept)]() mutable { kept.clear(); }).join();
+	return EXIT_SUCCESS;
+}
+
+// Small pieces are copied into one leaf up to the limit, at either end, and pieces held elsewhere only up to the lower
+// limit for shared ones, while turning coalescing off links every piece.
+
+int testCoalesce()
+{
+	char const cWord[] = "abcdefghijkl";
+
+	for (size_t limit : { 0, 128, 1024 })
+	{
+		String::Coalesce(limit, 32);
+
+		String back, front;
+		std::string text, reversed;
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::string word(cWord, 3 + i % 10);
+
+			back += String(word.c_str());
+			front = String(word.c_str()) + front;
+			text += word;
+			reversed = word + reversed;
+		}
+
+		assert(flat(back) == text && flat(front) == reversed);
+
+		for (auto const& s : { back, front })
+		{
+			std::vector<size_t> sizes;
+			for (auto piece : s.Spans()) sizes.push_back(piece.size());
+
+			if (!limit) { assert(sizes.size() > 900 && s.Depth() > 5); continue; }
+
+			assert(sizes.size() <= text.size() / (limit - 12) + 2);
+			for (size_t i = 1; i + 1 < sizes.size(); ++i) assert(sizes[i] > limit - 12);
+		}
+	}
+
+	String::Coalesce(128, 32);
+
+	String twenty("12345678901234567890"), thirty("123456789012345678901234567890"), copy = twenty;
+
+	assert(count(twenty + thirty) == 2);  // 50 bytes, and one of the pieces is also held by copy
+	assert(count(String("12345678901234567890") + thirty) == 1);
+
+	String::Coalesce(128, 64);
+	assert(count(twenty + thirty) == 1);
+
+	String::Coalesce(128, 32);
+	return EXIT_SUCCESS;
+}
+
+// Interned strings of the same bytes share one buffer while any of them lives, on any thread, and longer ones, ones
+// made otherwise, and ones made with interning off get buffers of their own.
+
+int testIntern()
+{
+	String::Intern(32);
+
+	char const* const szWord = "kissan paksut posket";  // 20 bytes, too many to be kept in the handle
+	char const* const szLong = "kissan paksut posket ja koiran kuono";
+
+	{
+		String a(szWord), b(szWord), c(std::string(szWord).c_str());
+
+		assert(static_cast<char const*>(a) == static_cast<char const*>(b) && a.View().data() == c.View().data());
+		assert(a == b && a.Hash() == String(szWord).Hash());
+
+		String d(szLong), e(szLong);
+		assert(static_cast<char const*>(d) != static_cast<char const*>(e) && d == e);
+
+		String f = String("kissan paksut ") + String("posket");
+		assert(f == a && f.View().data() != a.View().data());
+	}
+
+	{
+		String a(szWord);  // The entry of the earlier ones went with them
+		assert(strcmp(a, szWord) == 0 && a.Length() == 20);
+
+		std::vector<std::thread> threads;
+		std::vector<char const*> seen(4);
+
+		for (int i = 0; i < 4; ++i) threads.emplace_back([&seen, i, szWord]()
+		{
+			for (int k = 0; k < 1000; ++k) { String s(szWord); assert(s == szWord); seen[i] = s.View().data(); }
+		});
+
+		for (auto& thread : threads) thread.join();
+		for (auto p : seen) assert(p == a.View().data());  // a kept the entry alive all along
+	}
+
+	String::Intern(0);
+
+	String a(szWord), b(szWord);
+	assert(a.View().data() != b.View().data() && a == b);
+
+	return EXIT_SUCCESS;
+}
+
+// A literal is measured by the compiler, and the strings made from it, however short and on whichever thread, point
+// straight at its storage and read like any other string of the same bytes.
+
+int testLiteral()
+{
+	constexpr auto word = "h\xC3\xA4\xC3\xA4y\xC3\xB6 ja kissa"_s;
+	constexpr auto two = "ab"_s;
+
+	static_assert(word.nSize == 17 && word.nLength == 14 && two.nSize == 2 && two.nLength == 2, "Literal sizes are compile time constants");
+
+	String a = word, b = two, none = ""_s;
+
+	assert(a.View().data() == word.pBytes && static_cast<char const*>(a) == word.pBytes);
+	assert(b.View().data() == two.pBytes && static_cast<char const*>(b) == two.pBytes);
+	assert(a.Size() == 17 && a.Length() == 14 && a.At(1) == 0x00E4 && none.Size() == 0 && none.Length() == 0);
+	assert(a == String(word.pBytes) && a.Hash() == String(word.pBytes).Hash() && b.Hash() == String("ab").Hash());
+	assert(a.Tail(9) == "kissa"_s && a.Head(2) + two == "h\xC3\xA4" "ab"_s);
+
+	String sum;
+	for (int i = 0; i < 100; ++i) sum = "("_s + std::move(sum) + ")"_s;
+	assert(sum.Size() == 200 && sum.Head(1) == "("_s && sum.Tail(199) == ")"_s);
+
+	std::vector<std::thread> threads;
+	std::vector<char const*> seen(4);
+
+	for (int i = 0; i < 4; ++i) threads.emplace_back([&seen, i]() { for (int k = 0; k < 1000; ++k) { String s = "kissan paksut posket"_s; seen[i] = s.View().data(); } });
+	for (auto& thread : threads) thread.join();
+	for (auto p : seen) assert(p == seen[0] && !strcmp(p, "kissan paksut posket"));
+
+	return EXIT_SUCCESS;
+}
+
+// A leaf, and slices of one however they are nested, are viewed where their bytes are, without a copy or any change
+// to the string, and only the bytes of several pieces are flattened.
+
+int testView()
+{
+	std::string text;
+	for (int i = 0; i < 20; ++i) text += "h\xC3\xA4\xC3\xA4y\xC3\xB6 kissa ";
+
+	String const leaf(text.c_str());
+	char const* p = leaf;
+
+	assert(leaf.View() == text && leaf.Data() == p);
+
+	auto const head = leaf.Head(150), tail = leaf.Tail(50), middle = tail.Head(100);
+	auto const nDepth = head.Depth() + tail.Depth() + middle.Depth();
+
+	assert(head.View() == text.substr(0, bytes(text, 150)) && head.Data() == p);
+	assert(tail.View() == text.substr(bytes(text, 50)) && tail.Data() == p + bytes(text, 50));
+	assert(middle.View() == text.substr(bytes(text, 50), bytes(text, 150) - bytes(text, 50)) && middle.Data() == p + bytes(text, 50));
+	assert(head.Depth() + tail.Depth() + middle.Depth() == nDepth);
+
+	String::Coalesce(0, 0);
+	auto const r = rope(text, 20);
+	String::Coalesce(128, 32);
+
+	auto const q = r.Data();
+	assert(r.View() == text && q == r.Data() && q == static_cast<char const*>(r));
+
+	String s("kissa");
+	assert(s.View() == "kissa" && s.Data() >= reinterpret_cast<char const*>(&s) && s.Data() < reinterpret_cast<char const*>(&s + 1));
+
+	return EXIT_SUCCESS;
+}
+
+// Trees stay shallow whichever end they grow at, and every code point stays where it was put.
+
+int testBalance()
+{
+	String::Coalesce(0, 0);
+
+	for (int order = 0; order < 3; ++order)
+	{
+		String s;
+		std::string text;
+
+		for (int i = 0; i < 4096; ++i)
+		{
+			std::string piece(15 + i % 4, char('a' + i % 26));
+			auto bFront = order == 1 || (order == 2 && i % 2);
+
+			s = bFront ? String(piece.c_str()) + std::move(s) : std::move(s) + String(piece.c_str());
+			text = bFront ? piece + text : text + piece;
+		}
+
+		assert(s.Depth() <= 18);  // An AVL tree of 4096 leaves is at most 17 levels deep, and a skewed one thousands
+		assert(s.Length() == int(text.size()));
+
+		for (size_t i = 0; i < text.size(); i += 97) assert(s.At(int(i)) == Char_t(text[i]));
+		assert(s.At(-1) == 0 && s.At(s.Length()) == 0);
+	}
+
+	String::Coalesce(128, 32);
+	return EXIT_SUCCESS;
+}
+
+// Cursors step both ways over every kind of node, code point by code point, and agree with At() at every position.
+
+int testCursor()
+{
+	String::Coalesce(0, 0);
+
+	String parts[] = { String(""), String("kissa"), String("h\xC3\xA4\xC3\xA4y\xC3\xB6 ja \xE2\x82\xAC 100 kertaa"), String(0x00E4, 20), "valmis "_s };
+	String rope = parts[2] + parts[3] + parts[1] + parts[4] + parts[2].Tail(3) + parts[2].Head(7);
+
+	String::Coalesce(128, 32);
+
+	for (auto const& s : { parts[0], parts[1], parts[2], parts[3], rope })
+	{
+		int n = 0;
+		auto c = s.begin();
+
+		for (; c != s.end(); ++c, ++n) assert(c.Index() == n && *c == s.At(n));
+		assert(n == s.Length());
+
+		for (auto d = s.end(); d != s.begin(); )
+		{
+			--d;
+			--n;
+			assert(d.Index() == n && *d == s.At(n));
+		}
+
+		assert(n == 0);
+	}
+
+	auto c = rope.begin();
+	auto d = c++;
+
+	assert(d == rope.begin() && c.Index() == 1 && *c == 0x00E4);
+	assert(*--c == 'h' && c == d);
+
+	return EXIT_SUCCESS;
+}
+
+// The pieces of a string add up to its bytes: leaves and slices where they are, and repeated characters in chunks.
+
+int testSpans()
+{
+	String::Coalesce(0, 0);
+
+	String text("Mustan kissan paksut posket");
+	String repeat(0x00E4, 300);
+	String rope = text + repeat + text.Tail(7).Head(6) + "!"_s;
+
+	String::Coalesce(128, 32);
+
+	for (auto const& s : { String(), String("kissa"), text, repeat, rope })
+	{
+		std::string spans, visited;
+		int count = 0;
+
+		for (auto piece : s.Spans()) { assert(!piece.empty()); spans.append(piece.data(), piece.size()); ++count; }
+		s.Visit([&visited](std::string_view piece) { visited.append(piece.data(), piece.size()); });
+
+		assert(spans == flat(s) && visited == spans);
+		assert(count == 0 ? !s.Size() : count <= int(s.Size() / 128) + 4);
+	}
+
+	auto span = rope.Spans();
+	auto first = span++;
+
+	assert(*first == "Mustan kissan paksut posket" && span->size() <= 256 && first != span);
+
+	// Only n bytes are written, even where they end inside a repeated two byte character.
+
+	char c[8];
+
+	memset(c, 'x', sizeof c);
+	repeat.Get(c, 5);
+	assert(!memcmp(c, "\xC3\xA4\xC3\xA4\xC3xxx", 8));
+
+	memset(c, 'x', sizeof c);
+	(String("ab") + repeat).Get(c, 5);
+	assert(!memcmp(c, "ab\xC3\xA4\xC3xxx", 8));
+
+	return EXIT_SUCCESS;
+}
+
+// Written bytes read back the same, however many pieces there are and whatever kind.
+
+int testWriteTo()
+{
+	String::Coalesce(0, 0);
+
+	String rope;
+	std::string text, repeat;
+
+	for (int i = 0; i < 2000; ++i) repeat += "\xC3\xA4";
+
+	for (int i = 0; i < 3000; ++i)  // More pieces than one writev() takes
+	{
+		std::string piece = std::to_string(i) + (i % 2 ? " kissa " : " h\xC3\xA4\xC3\xA4y\xC3\xB6 ");
+
+		rope += i % 100 ? String(piece.c_str()) : String(0x00E4, 2000);
+		text += i % 100 ? piece : repeat;
+	}
+
+	String::Coalesce(128, 32);
+
+	for (auto const& s : { String(), String("kissa"), rope })
+	{
+		auto file = tmpfile();
+		assert(file);
+
+		assert(s.WriteTo(fileno(file)));
+		rewind(file);
+
+		std::string read(s.Size() + 1, '\0');
+		assert(fread(&read[0], 1, read.size(), file) == s.Size());
+		read.resize(s.Size());
+		fclose(file);
+
+		assert(read == flat(s));
+	}
+
+	assert(flat(rope) == text);
+	return EXIT_SUCCESS;
+}
+
+// A rope that several threads only read needs no locking: each thread may read a copy of its own, and all of them may
+// read one handle that has been published.  Both ways share the flat copy and the hash that the nodes work out.
+
+int testFanOut()
+{
+	String rope;
+	std::string text, repeat;
+
+	for (int i = 0; i < 2000; ++i) repeat += "\xC3\xA4";
+
+	for (int i = 0; i < 200; ++i)
+	{
+		std::string piece(20 + i % 5, char('a' + i % 26));
+
+		rope += String(piece.c_str());
+		text += piece;
+	}
+
+	String published = rope + "."_s;
+	published.Publish();
+
+	auto const nHash = String(text.c_str()).Hash();
+	std::vector<std::thread> threads;
+	std::atomic<int> nWrong{ 0 };
+
+	for (int k = 0; k < 4; ++k) threads.emplace_back([&]()
+	{
+		for (int i = 0; i < 1000; ++i)
+		{
+			String copy = rope;
+
+			if (strcmp(copy, text.c_str()) || copy.Hash() != nHash || copy.Length() != int(text.size())) ++nWrong;
+			if (strncmp(published, text.c_str(), text.size()) || published.Length() != int(text.size()) + 1) ++nWrong;
+		}
+	});
+
+	for (auto& thread : threads) thread.join();
+
+	assert(!nWrong);
+	return EXIT_SUCCESS;
+}
+
+// Copies of the same ropes are made and destroyed on several threads at once, and strings that one thread builds are
+// destroyed on another.  Neither needs Publish().
+
+int testThreads()
+{
+	std::vector<String> ropes;
+
+	for (int i = 0; i < 16; ++i) ropes.push_back(String('a' + i, 40 + i) + String('0' + i % 10, 3));
+
+	std::mutex mutex;
+	std::vector<String> handed;
+	std::vector<std::thread> threads;
+
+	for (int k = 0; k < 4; ++k) threads.emplace_back([&ropes, &mutex, &handed, k]()
+	{
+		for (int i = 0; i < 20000; ++i)
+		{
+			auto& a = ropes[(i + k) % ropes.size()];
+			auto& b = ropes[(i * 7 + k) % ropes.size()];
+			String c = a + b;
+
+			assert(c.Length() == a.Length() + b.Length());
+			assert(c.Tail(a.Length()).Equals(b));
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (i % 2) handed.push_back(std::move(c));
+			else if (!handed.empty()) handed.pop_back();
+		}
+	});
+
+	for (auto& thread : threads) thread.join();
+
+	for (auto& item : handed) assert(item.Length() > 80);
+	handed.clear();
+
+	return EXIT_SUCCESS;
+}
+
+// Holders of one node share its flat copy until the budget drops it, and a pointer taken before that stays good.
+
+int testMemoize()
+{
+	String node = String('a', 300) + String('b', 300);
+	String first = node, second = node;
+	char const* p = first;
+
+	assert(p == static_cast<char const*>(second));
+
+	String::Memoize(0);
+
+	String third = node;
+	char const* q = third;
+
+	assert(q != p && !strcmp(p, q));
+
+	// With room for one copy, the older one is dropped from its node when the next is attached, while a slice of a
+	// leaf, which has no terminated buffer, keeps its copy like a concatenation does.
+
+	String::Memoize(700);
+
+	String older = String('c', 600) + String('d', 10), newer = String('e', 600) + String('f', 10);
+	String olderCopy = older, newerCopy = newer;
+	char const* r = olderCopy;
+	char const* s = newerCopy;
+
+	assert(s == static_cast<char const*>(String(newer)));
+	assert(r != static_cast<char const*>(String(older)));
+	assert(!strcmp(r, flat(older).c_str()) && !strcmp(s, flat(newer).c_str()));
+
+	String leaf(std::string(100, 'g').append(100, 'h').c_str());
+	String slice = leaf.Head(150), sliceCopy = slice;
+
+	assert(static_cast<char const*>(slice) == static_cast<char const*>(sliceCopy));
+	assert(flat(slice) == std::string(100, 'g').append(50, 'h'));
+
+	String::Memoize(size_t(64) << 20);
+	return EXIT_SUCCESS;
+}
+
+// Matches are found where the flat string has them, also across pieces and with needles longer than a piece.
+
+int testFind()
+{
+	std::string text;
+	for (int i = 0; i < 200; ++i) text += i % 7 ? "kissa ja koira " : "h\xC3\xA4\xC3\xA4y\xC3\xB6 ja kissa ";
+
+	String haystack = rope(text, 3);
+	assert(flat(haystack) == text);
+
+	char const* needles[] = { "k", "kissa", "ja koira h\xC3\xA4\xC3\xA4", "\xC3\xB6", "koira kissa", "y\xC3\xB6 ja kissa kissa ja koira kissa ja koira" };
+
+	for (auto p : needles)
+	{
+		std::string needle(p);
+		auto i = text.find(needle), j = text.rfind(needle);
+
+		assert(haystack.Find(String(p)) == (i == std::string::npos ? -1 : points(text, i)));
+		assert(haystack.RFind(String(p)) == (j == std::string::npos ? -1 : points(text, j)));
+		assert(haystack.Contains(rope(needle, 2)) == (i != std::string::npos));
+
+		for (int nFrom = 1; nFrom < 3000; nFrom += 97)
+		{
+			auto k = text.find(needle, bytes(text, nFrom));
+			assert(haystack.Find(String(p), nFrom) == (k == std::string::npos ? -1 : points(text, k)));
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Order and equality follow the bytes whatever the pieces, and equal strings hash alike.
+
+int testCompare()
+{
+	std::string words[] = { "", "a", "kissa", "kissa ja koira", "kissan paksut posket ja koiran kuono", "kissan paksut posket ja koiran kuonot", "\xC3\xA4iti" };
+
+	for (auto& a : words) for (auto& b : words)
+	{
+		auto n = a.compare(b);
+
+		for (size_t nStep = 1; nStep < 6; nStep += 2)
+		{
+			String r = rope(a, nStep), s = rope(b, nStep + 1);
+
+			assert((r.Compare(s) > 0) == (n > 0) && (r.Compare(s) < 0) == (n < 0));
+			assert((r.Compare(b.c_str()) > 0) == (n > 0) && (r.Compare(b.c_str()) < 0) == (n < 0));
+			assert(r.Equals(s) == !n && r.Equals(b.c_str()) == !n);
+			assert(!n ? r.Hash() == s.Hash() && r.Hash() == String(b.c_str()).Hash() : true);
+		}
+	}
+
+	String left = String('x', 40) + String('y', 40), right = String('x', 20) + (String('x', 20) + String('y', 40));
+	assert(left == right && left.Hash() == right.Hash());
+	assert(left + "z"_s > right && left < right + String('z', 1));
+
+	// A concatenation that is hashed and then grows in place hashes like its new contents, and leaves hash the same
+	// every time they are asked.
+
+	String::Coalesce(0, 0);
+
+	String grown = String("kissan paksut posket") + String(" ja koiran kuono");
+	auto const nBefore = grown.Hash();
+
+	grown += String("t ja h\xC3\xA4nt\xC3\xA4");
+	String::Coalesce(128, 32);
+
+	assert(grown.Hash() != nBefore && grown.Hash() == String(flat(grown).c_str()).Hash());
+	assert(String("kissan paksut posket").Hash() == String("kissan paksut posket").Hash() && String('x', 40).Hash() == left.Head(40).Hash());
+
+	return EXIT_SUCCESS;
+}
+
+// Input of any size comes back byte for byte, from a stream and from a file descriptor.
+
+int testRead()
+{
+	std::string text;
+	for (int i = 0; text.size() < 300000; ++i) text += std::to_string(i) + (i % 3 ? " kissa " : " h\xC3\xA4\xC3\xA4y\xC3\xB6 ");
+
+	std::istringstream stream(text);
+	String r = String::Read(stream);
+
+	assert(r.Size() == text.size() && r == text.c_str());
+
+	auto file = tmpfile();
+	assert(file);
+
+	fwrite(text.data(), 1, text.size(), file);
+	fflush(file);
+	rewind(file);
+
+	String s = String::Read(fileno(file));
+	fclose(file);
+
+	assert(s == r && s.Length() == points(text, text.size()));
+
+	std::istringstream empty;
+	assert(String::Read(empty).Size() == 0);
+
+	return EXIT_SUCCESS;
+}
+
+// Slots are filled in any order and as often as asked, braces are escaped, and mistakes are thrown.
+
+int testFormat()
+{
+	String::Format copied("Copied {1} files to {0}, {1} in all");
+
+	assert(copied("kansio", "3") == "Copied 3 files to kansio, 3 in all");
+	assert(copied(String('k', 30), "kolme") == ("Copied kolme files to " + std::string(30, 'k') + ", kolme in all").c_str());
+	assert(String::Format("{{{0}}}")("x") == "{x}");
+
+	int nThrown = 0;
+	try { copied("kansio"); } catch (char const*) { ++nThrown; }
+	try { String::Format("{0"); } catch (char const*) { ++nThrown; }
+	assert(nThrown == 2);
+
+	String::Catalog catalog("# Viestit\n\ncopied = Kopioitiin {1} tiedostoa kansioon {0}\n  empty=Tyhj\xC3\xA4  \nempty = Ei mit\xC3\xA4\xC3\xA4n\n");
+
+	assert(catalog.Size() == 2 && !catalog.Find("missing"));
+	assert(catalog["copied"]("kansio", "3") == "Kopioitiin 3 tiedostoa kansioon kansio");
+	assert(catalog["empty"]() == "Ei mit\xC3\xA4\xC3\xA4n");
+
+	return EXIT_SUCCESS;
+}
+
+// A mapped file reads like the bytes written to it, and a window is narrowed to the code points that it holds whole.
+
+int testFromFile()
+{
+	char const* szPath = "tekstaus.tmp";
+	std::string text;
+	for (int i = 0; i < 1000; ++i) text += "h\xC3\xA4\xC3\xA4y\xC3\xB6 " + std::to_string(i) + " ";
+
+	std::ofstream(szPath, std::ios::binary).write(text.data(), std::streamsize(text.size()));
+
+	String all = String::FromFile(szPath);
+	String window = String::FromFile(szPath, 2, 7);  // Starts and ends inside a sequence
+	String rest = String::FromFile(szPath, text.size() - 10);
+	String nothing = String::FromFile(szPath, text.size());
+
+	assert(all == text.c_str() && all.Length() == points(text, text.size()));
+	assert(window == "\xC3\xA4y\xC3\xB6 ");
+	assert(rest == text.substr(text.size() - 10).c_str());
+	assert(nothing.Size() == 0);
+	assert(all.Find("y\xC3\xB6 999"_s) == points(text, text.rfind("y\xC3\xB6 999")));
+
+	remove(szPath);
+	assert(all.Tail(all.Length() - 5) == text.substr(text.size() - 5).c_str());  // The mapping outlives the file name
+
+	int nThrown = 0;
+	try { String::FromFile(szPath); } catch (char const*) { ++nThrown; }
+	assert(nThrown == 1);
+
+	// A page of two byte characters, a multiple of the stride of the index in code points, is not read past its end.
+
+	std::string page;
+	while (page.size() < 4096) page += "\xC3\xA4";
+
+	std::ofstream(szPath, std::ios::binary).write(page.data(), std::streamsize(page.size()));
+	String mapped = String::FromFile(szPath);
+	remove(szPath);
+
+	assert(mapped.Length() == 2048 && mapped.Tail(200) == String(0x00E4, 1848));
+	assert(mapped.Head(2047).Size() == 4094 && mapped.At(2047) == 0x00E4 && mapped.At(2048) == '\0');
+
+	return EXIT_SUCCESS;
+}
+
 int main() try
 {
 	String none;
@@ -95,6 +884,8 @@ int main() try
 	evaluate(head+tail);
 	evaluate(tail+head);
 
+	String moved = sum;
+
 	for (int i = 0; i < 100; ++i) sum = "(" + sum;
 	evaluate(sum);
 	for (int i = 0; i < 100; ++i) sum = sum + ")";
@@ -102,6 +893,40 @@ int main() try
 	for (int i = 0; i < 100; ++i) sum = "("+ sum + ")";
 	evaluate(sum);
 
+	// The same again with the string moved through, or appended to, so that its nodes are extended in place.
+
+	for (int i = 0; i < 100; ++i) moved = "("_s + std::move(moved);
+	evaluate(moved);
+	for (int i = 0; i < 100; ++i) moved += ")"_s;
+	evaluate(moved);
+	for (int i = 0; i < 100; ++i) moved = "("_s + std::move(moved) + ")"_s;
+	evaluate(moved);
+
+	assert(moved == sum);
+
+	int count = 0;
+	for (auto c : sum) count += c != '\0';
+	assert(count == sum.Length());
+
+	testFind();
+	testCompare();
+	testRead();
+	testFormat();
+	testFromFile();
+	testInline();
+	testArena();
+	testCoalesce();
+	testIntern();
+	testLiteral();
+	testView();
+	testBalance();
+	testCursor();
+	testSpans();
+	testWriteTo();
+	testFanOut();
+	testThreads();
+	testMemoize();
+
 	return EXIT_SUCCESS;
 }
 catch (char const* p)